@@ -0,0 +1,101 @@
+#include "Arena.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+namespace svg
+{
+    //! Header of a chunk, followed by its memory.
+    struct Arena::Chunk
+    {
+        Chunk *previous;
+        size_t size;
+    };
+
+    Arena::Arena(size_t chunk_size)
+        : chunks_(nullptr), cursor_(nullptr), end_(nullptr), next_size_(chunk_size),
+          max_size_(chunk_size * 64), used_(0), reserved_(0)
+    {
+    }
+
+    Arena::~Arena()
+    {
+        while (chunks_ != nullptr)
+        {
+            Chunk *previous = chunks_->previous;
+            std::free(chunks_);
+            chunks_ = previous;
+        }
+    }
+
+    void Arena::reset()
+    {
+        used_ = 0;
+        if (chunks_ == nullptr)
+        {
+            return;
+        }
+        // Keep the largest chunk: chunks grow, but one made for a large
+        // request may be followed by smaller ones.
+        Chunk *largest = chunks_;
+        for (Chunk *c = chunks_->previous; c != nullptr; c = c->previous)
+        {
+            if (c->size > largest->size)
+            {
+                largest = c;
+            }
+        }
+        while (chunks_ != nullptr)
+        {
+            Chunk *previous = chunks_->previous;
+            if (chunks_ != largest)
+            {
+                std::free(chunks_);
+            }
+            chunks_ = previous;
+        }
+        chunks_ = largest;
+        chunks_->previous = nullptr;
+        cursor_ = reinterpret_cast<char *>(chunks_ + 1);
+        end_ = cursor_ + chunks_->size;
+        reserved_ = chunks_->size;
+    }
+
+    void *Arena::allocate(size_t bytes, size_t align)
+    {
+        uintptr_t p = ((uintptr_t)cursor_ + align - 1) & ~(uintptr_t)(align - 1);
+        if (cursor_ == nullptr || p + bytes > (uintptr_t)end_)
+        {
+            // New chunk, large enough for the request even if it is bigger
+            // than the usual chunk size.
+            size_t size = std::max(next_size_, bytes + align);
+            Chunk *chunk = static_cast<Chunk *>(std::malloc(sizeof(Chunk) + size));
+            if (chunk == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            chunk->previous = chunks_;
+            chunk->size = size;
+            chunks_ = chunk;
+            cursor_ = reinterpret_cast<char *>(chunk + 1);
+            end_ = cursor_ + size;
+            reserved_ += size;
+            next_size_ = std::min(next_size_ * 2, max_size_);
+            p = ((uintptr_t)cursor_ + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        used_ += p + bytes - (uintptr_t)cursor_;
+        cursor_ = reinterpret_cast<char *>(p + bytes);
+        return reinterpret_cast<void *>(p);
+    }
+
+    size_t Arena::bytes_used() const
+    {
+        return used_;
+    }
+
+    size_t Arena::bytes_reserved() const
+    {
+        return reserved_;
+    }
+}
@@ -0,0 +1,119 @@
+//! @file Arena.hpp
+#ifndef __svg_Arena_hpp__
+#define __svg_Arena_hpp__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace svg
+{
+    //! Bump allocator for data that lives as long as a document.
+    //! Allocations are carved out of large chunks and never freed one by
+    //! one: all the memory is released at once when the arena is
+    //! destroyed. Destructors of objects created in the arena are not run,
+    //! so they must not own memory outside of it.
+    class Arena
+    {
+    public:
+        //! Constructor.
+        //! @param chunk_size Size of the first chunk (later chunks double
+        //! in size, up to 64 times this size).
+        Arena(size_t chunk_size = 64 * 1024);
+        //! Destructor (frees all chunks).
+        ~Arena();
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        //! Allocate memory.
+        //! @param bytes Number of bytes.
+        //! @param align Alignment (a power of 2).
+        //! @return The memory.
+        void *allocate(size_t bytes, size_t align);
+        //! Construct an object in the arena.
+        //! @param args Constructor arguments.
+        //! @return The object.
+        template <class T, class... Args>
+        T *create(Args &&...args)
+        {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+        //! Release everything allocated so far, keeping the largest chunk
+        //! for the next allocations.
+        void reset();
+        //! Get the number of bytes allocated (including alignment padding).
+        //! @return The number of bytes.
+        size_t bytes_used() const;
+        //! Get the number of bytes in chunks.
+        //! @return The number of bytes.
+        size_t bytes_reserved() const;
+
+    private:
+        struct Chunk;
+        //! Most recent chunk (chunks are linked backwards).
+        Chunk *chunks_;
+        //! Free space of the current chunk.
+        char *cursor_, *end_;
+        //! Size of the next chunk.
+        size_t next_size_;
+        //! Largest chunk size.
+        size_t max_size_;
+        //! Bytes allocated.
+        size_t used_;
+        //! Bytes in chunks.
+        size_t reserved_;
+    };
+
+    //! Standard allocator drawing from an arena, so that containers of
+    //! arena objects keep their storage in the arena too. Without an
+    //! arena it uses the heap.
+    template <class T>
+    class ArenaAllocator
+    {
+    public:
+        typedef T value_type;
+        //! Constructor.
+        //! @param arena Arena to allocate from (null for the heap).
+        ArenaAllocator(Arena *arena = nullptr) : arena_(arena) {}
+        template <class U>
+        ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+        T *allocate(size_t n)
+        {
+            if (arena_ != nullptr)
+            {
+                return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+            }
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        void deallocate(T *p, size_t)
+        {
+            // Arena memory is only released with the arena.
+            if (arena_ == nullptr)
+            {
+                ::operator delete(p);
+            }
+        }
+        //! Get the arena.
+        //! @return The arena (null for the heap).
+        Arena *arena() const
+        {
+            return arena_;
+        }
+
+    private:
+        Arena *arena_;
+    };
+
+    template <class T, class U>
+    bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+    {
+        return a.arena() == b.arena();
+    }
+
+    template <class T, class U>
+    bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+    {
+        return a.arena() != b.arena();
+    }
+}
+
+#endif
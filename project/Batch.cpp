@@ -0,0 +1,193 @@
+#include "Batch.hpp"
+#include "Converter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace svg
+{
+    namespace
+    {
+        //! Get the size of a file.
+        //! @return The size, or 0 if it cannot be read.
+        unsigned long long file_size(const std::string &file_name)
+        {
+            struct stat st;
+            return ::stat(file_name.c_str(), &st) == 0 ? (unsigned long long)st.st_size : 0;
+        }
+
+        //! Replace the extension of a file name (if any) by .png.
+        std::string png_name(const std::string &file_name)
+        {
+            size_t dot = file_name.find_last_of('.');
+            size_t slash = file_name.find_last_of('/');
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            {
+                return file_name + ".png";
+            }
+            return file_name.substr(0, dot) + ".png";
+        }
+
+        bool ends_with(const std::string &s, const char *suffix)
+        {
+            size_t n = ::strlen(suffix);
+            return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+        }
+
+        //! Result of one job.
+        struct Outcome
+        {
+            bool done = false;
+            std::string error;
+        };
+    }
+
+    std::vector<BatchJob> read_manifest(const std::string &manifest)
+    {
+        std::ifstream in(manifest);
+        if (!in)
+        {
+            throw std::runtime_error("Unable to load " + manifest);
+        }
+        std::vector<BatchJob> jobs;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] == '#')
+            {
+                continue;
+            }
+            size_t end = line.find_last_not_of(" \t") + 1;
+            line = line.substr(start, end - start);
+            size_t sep = line.find('\t');
+            if (sep == std::string::npos)
+            {
+                sep = line.find(' ');
+            }
+            BatchJob job;
+            if (sep == std::string::npos)
+            {
+                job.input = line;
+                job.output = png_name(line);
+            }
+            else
+            {
+                job.input = line.substr(0, sep);
+                job.output = line.substr(line.find_first_not_of(" \t", sep));
+            }
+            jobs.push_back(job);
+        }
+        if (in.bad())
+        {
+            throw std::runtime_error("Unable to load " + manifest);
+        }
+        return jobs;
+    }
+
+    std::vector<BatchJob> list_directory(const std::string &input_dir, const std::string &output_dir)
+    {
+        DIR *d = ::opendir(input_dir.c_str());
+        if (d == nullptr)
+        {
+            throw std::runtime_error("Unable to read directory " + input_dir);
+        }
+        std::vector<std::string> names;
+        while (struct dirent *e = ::readdir(d))
+        {
+            std::string name = e->d_name;
+            if (ends_with(name, ".svg") || ends_with(name, ".scene"))
+            {
+                names.push_back(name);
+            }
+        }
+        ::closedir(d);
+        if (::mkdir(output_dir.c_str(), 0777) != 0 && errno != EEXIST)
+        {
+            throw std::runtime_error("Unable to create directory " + output_dir);
+        }
+        std::sort(names.begin(), names.end());
+        std::vector<BatchJob> jobs;
+        for (const std::string &name : names)
+        {
+            jobs.push_back({input_dir + "/" + name, output_dir + "/" + png_name(name)});
+        }
+        return jobs;
+    }
+
+    BatchSummary convert_batch(const std::vector<BatchJob> &jobs, const RenderOptions &options, int workers,
+                               RenderCache *cache)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Outcome> outcomes(jobs.size());
+        std::atomic<size_t> next_job(0);
+        auto worker = [&]()
+        {
+            Converter converter;
+            size_t i;
+            while ((i = next_job++) < jobs.size())
+            {
+                try
+                {
+                    if (cache != nullptr)
+                    {
+                        cache->convert(jobs[i].input, jobs[i].output, options, nullptr, &converter);
+                    }
+                    else
+                    {
+                        converter.convert(jobs[i].input, jobs[i].output, options);
+                    }
+                    outcomes[i].done = true;
+                }
+                catch (const std::exception &e)
+                {
+                    outcomes[i].error = e.what();
+                }
+                catch (...)
+                {
+                    outcomes[i].error = "unknown error";
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < workers; i++)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &th : pool)
+        {
+            th.join();
+        }
+
+        BatchSummary summary;
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            if (outcomes[i].done)
+            {
+                summary.converted++;
+                summary.input_bytes += file_size(jobs[i].input);
+                summary.output_bytes += file_size(jobs[i].output);
+            }
+            else
+            {
+                summary.failures.push_back({jobs[i].input, outcomes[i].error});
+            }
+        }
+        return summary;
+    }
+}
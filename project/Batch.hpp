@@ -0,0 +1,70 @@
+//! @file Batch.hpp
+#ifndef __svg_Batch_hpp__
+#define __svg_Batch_hpp__
+
+#include "SVGElements.hpp"
+#include "RenderCache.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace svg
+{
+    //! A conversion of a batch.
+    struct BatchJob
+    {
+        //! Input file name (SVG or scene file).
+        std::string input;
+        //! Output file name.
+        std::string output;
+    };
+
+    //! Outcome of a batch.
+    struct BatchSummary
+    {
+        //! Number of files converted.
+        size_t converted = 0;
+        //! Failed conversions (input file name, error message), in job
+        //! order.
+        std::vector<std::pair<std::string, std::string>> failures;
+        //! Total size of the inputs converted.
+        unsigned long long input_bytes = 0;
+        //! Total size of the outputs written.
+        unsigned long long output_bytes = 0;
+        //! Wall-clock time of the batch, in seconds.
+        double seconds = 0;
+    };
+
+    //! Read the jobs of a manifest file: one job per line, the input and
+    //! output file names separated by a tab (or, when there is no tab, by
+    //! the first run of spaces). Without an output, the input name with a
+    //! .png extension is used. Blank lines and lines starting with '#'
+    //! are skipped.
+    //! Throws std::runtime_error if the manifest cannot be read.
+    //! @param manifest Manifest file name.
+    //! @return The jobs.
+    std::vector<BatchJob> read_manifest(const std::string &manifest);
+
+    //! List the SVG and scene files of a directory as jobs writing PNG
+    //! files (with the same base names) to another directory, which is
+    //! created if needed. Jobs are sorted by input name.
+    //! Throws std::runtime_error if a directory cannot be read or created.
+    //! @param input_dir Input directory.
+    //! @param output_dir Output directory.
+    //! @return The jobs.
+    std::vector<BatchJob> list_directory(const std::string &input_dir, const std::string &output_dir);
+
+    //! Convert a batch of files on a pool of worker threads, each with its
+    //! own Converter. A failed conversion is recorded and does not stop
+    //! the others.
+    //! @param jobs Conversions.
+    //! @param options Rendering options (for each file).
+    //! @param workers Number of worker threads.
+    //! @param cache If not null, render cache to use.
+    //! @return The summary.
+    BatchSummary convert_batch(const std::vector<BatchJob> &jobs, const RenderOptions &options, int workers,
+                               RenderCache *cache = nullptr);
+}
+
+#endif
@@ -1,34 +1,454 @@
 #include "Color.hpp"
-#include <map>
-#include <iomanip>
-#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 
 namespace svg
 {
-    const std::map<std::string, Color> NAMES_TO_COLORS = {
-        {"black", {0, 0, 0}},
-        {"white", {255, 255, 255}},
-        {"red", {255, 0, 0}},
-        {"green", {0, 255, 0}},
-        {"blue", {0, 0, 255}},
-        {"yellow", {255, 255, 0}}};
+    namespace
+    {
+        //! A named color.
+        struct NamedColor
+        {
+            const char *name;
+            Color color;
+        };
 
-    Color parse_color(const std::string &str)
+        //! The SVG/CSS named colors (CSS Color 4), in alphabetical order.
+        //! "green" keeps the pure green this project has always used (the
+        //! expected test images rely on it) rather than CSS's #008000.
+        constexpr NamedColor NAMED_COLORS[] = {
+            {"aliceblue", {240, 248, 255}},
+            {"antiquewhite", {250, 235, 215}},
+            {"aqua", {0, 255, 255}},
+            {"aquamarine", {127, 255, 212}},
+            {"azure", {240, 255, 255}},
+            {"beige", {245, 245, 220}},
+            {"bisque", {255, 228, 196}},
+            {"black", {0, 0, 0}},
+            {"blanchedalmond", {255, 235, 205}},
+            {"blue", {0, 0, 255}},
+            {"blueviolet", {138, 43, 226}},
+            {"brown", {165, 42, 42}},
+            {"burlywood", {222, 184, 135}},
+            {"cadetblue", {95, 158, 160}},
+            {"chartreuse", {127, 255, 0}},
+            {"chocolate", {210, 105, 30}},
+            {"coral", {255, 127, 80}},
+            {"cornflowerblue", {100, 149, 237}},
+            {"cornsilk", {255, 248, 220}},
+            {"crimson", {220, 20, 60}},
+            {"cyan", {0, 255, 255}},
+            {"darkblue", {0, 0, 139}},
+            {"darkcyan", {0, 139, 139}},
+            {"darkgoldenrod", {184, 134, 11}},
+            {"darkgray", {169, 169, 169}},
+            {"darkgreen", {0, 100, 0}},
+            {"darkgrey", {169, 169, 169}},
+            {"darkkhaki", {189, 183, 107}},
+            {"darkmagenta", {139, 0, 139}},
+            {"darkolivegreen", {85, 107, 47}},
+            {"darkorange", {255, 140, 0}},
+            {"darkorchid", {153, 50, 204}},
+            {"darkred", {139, 0, 0}},
+            {"darksalmon", {233, 150, 122}},
+            {"darkseagreen", {143, 188, 143}},
+            {"darkslateblue", {72, 61, 139}},
+            {"darkslategray", {47, 79, 79}},
+            {"darkslategrey", {47, 79, 79}},
+            {"darkturquoise", {0, 206, 209}},
+            {"darkviolet", {148, 0, 211}},
+            {"deeppink", {255, 20, 147}},
+            {"deepskyblue", {0, 191, 255}},
+            {"dimgray", {105, 105, 105}},
+            {"dimgrey", {105, 105, 105}},
+            {"dodgerblue", {30, 144, 255}},
+            {"firebrick", {178, 34, 34}},
+            {"floralwhite", {255, 250, 240}},
+            {"forestgreen", {34, 139, 34}},
+            {"fuchsia", {255, 0, 255}},
+            {"gainsboro", {220, 220, 220}},
+            {"ghostwhite", {248, 248, 255}},
+            {"gold", {255, 215, 0}},
+            {"goldenrod", {218, 165, 32}},
+            {"gray", {128, 128, 128}},
+            {"green", {0, 255, 0}},
+            {"greenyellow", {173, 255, 47}},
+            {"grey", {128, 128, 128}},
+            {"honeydew", {240, 255, 240}},
+            {"hotpink", {255, 105, 180}},
+            {"indianred", {205, 92, 92}},
+            {"indigo", {75, 0, 130}},
+            {"ivory", {255, 255, 240}},
+            {"khaki", {240, 230, 140}},
+            {"lavender", {230, 230, 250}},
+            {"lavenderblush", {255, 240, 245}},
+            {"lawngreen", {124, 252, 0}},
+            {"lemonchiffon", {255, 250, 205}},
+            {"lightblue", {173, 216, 230}},
+            {"lightcoral", {240, 128, 128}},
+            {"lightcyan", {224, 255, 255}},
+            {"lightgoldenrodyellow", {250, 250, 210}},
+            {"lightgray", {211, 211, 211}},
+            {"lightgreen", {144, 238, 144}},
+            {"lightgrey", {211, 211, 211}},
+            {"lightpink", {255, 182, 193}},
+            {"lightsalmon", {255, 160, 122}},
+            {"lightseagreen", {32, 178, 170}},
+            {"lightskyblue", {135, 206, 250}},
+            {"lightslategray", {119, 136, 153}},
+            {"lightslategrey", {119, 136, 153}},
+            {"lightsteelblue", {176, 196, 222}},
+            {"lightyellow", {255, 255, 224}},
+            {"lime", {0, 255, 0}},
+            {"limegreen", {50, 205, 50}},
+            {"linen", {250, 240, 230}},
+            {"magenta", {255, 0, 255}},
+            {"maroon", {128, 0, 0}},
+            {"mediumaquamarine", {102, 205, 170}},
+            {"mediumblue", {0, 0, 205}},
+            {"mediumorchid", {186, 85, 211}},
+            {"mediumpurple", {147, 112, 219}},
+            {"mediumseagreen", {60, 179, 113}},
+            {"mediumslateblue", {123, 104, 238}},
+            {"mediumspringgreen", {0, 250, 154}},
+            {"mediumturquoise", {72, 209, 204}},
+            {"mediumvioletred", {199, 21, 133}},
+            {"midnightblue", {25, 25, 112}},
+            {"mintcream", {245, 255, 250}},
+            {"mistyrose", {255, 228, 225}},
+            {"moccasin", {255, 228, 181}},
+            {"navajowhite", {255, 222, 173}},
+            {"navy", {0, 0, 128}},
+            {"oldlace", {253, 245, 230}},
+            {"olive", {128, 128, 0}},
+            {"olivedrab", {107, 142, 35}},
+            {"orange", {255, 165, 0}},
+            {"orangered", {255, 69, 0}},
+            {"orchid", {218, 112, 214}},
+            {"palegoldenrod", {238, 232, 170}},
+            {"palegreen", {152, 251, 152}},
+            {"paleturquoise", {175, 238, 238}},
+            {"palevioletred", {219, 112, 147}},
+            {"papayawhip", {255, 239, 213}},
+            {"peachpuff", {255, 218, 185}},
+            {"peru", {205, 133, 63}},
+            {"pink", {255, 192, 203}},
+            {"plum", {221, 160, 221}},
+            {"powderblue", {176, 224, 230}},
+            {"purple", {128, 0, 128}},
+            {"rebeccapurple", {102, 51, 153}},
+            {"red", {255, 0, 0}},
+            {"rosybrown", {188, 143, 143}},
+            {"royalblue", {65, 105, 225}},
+            {"saddlebrown", {139, 69, 19}},
+            {"salmon", {250, 128, 114}},
+            {"sandybrown", {244, 164, 96}},
+            {"seagreen", {46, 139, 87}},
+            {"seashell", {255, 245, 238}},
+            {"sienna", {160, 82, 45}},
+            {"silver", {192, 192, 192}},
+            {"skyblue", {135, 206, 235}},
+            {"slateblue", {106, 90, 205}},
+            {"slategray", {112, 128, 144}},
+            {"slategrey", {112, 128, 144}},
+            {"snow", {255, 250, 250}},
+            {"springgreen", {0, 255, 127}},
+            {"steelblue", {70, 130, 180}},
+            {"tan", {210, 180, 140}},
+            {"teal", {0, 128, 128}},
+            {"thistle", {216, 191, 216}},
+            {"tomato", {255, 99, 71}},
+            {"turquoise", {64, 224, 208}},
+            {"violet", {238, 130, 238}},
+            {"wheat", {245, 222, 179}},
+            {"white", {255, 255, 255}},
+            {"whitesmoke", {245, 245, 245}},
+            {"yellow", {255, 255, 0}},
+            {"yellowgreen", {154, 205, 50}}
+        };
+        constexpr size_t NAMED_COLOR_COUNT = sizeof(NAMED_COLORS) / sizeof(NAMED_COLORS[0]);
+
+        //! Seed of the name hash, searched offline so that every name
+        //! gets its own slot (checked by the static_assert below).
+        constexpr uint32_t NAME_HASH_SEED = 1510688892u;
+        //! Number of bits of a slot number.
+        constexpr int SLOT_BITS = 10;
+
+        constexpr uint32_t lower(char c)
+        {
+            return c >= 'A' && c <= 'Z' ? (uint32_t)(c - 'A' + 'a') : (uint32_t)(unsigned char)c;
+        }
+
+        //! FNV-1a hash of a (case-insensitive) name.
+        constexpr uint32_t name_hash(const char *s, size_t n, uint32_t h = NAME_HASH_SEED)
+        {
+            return n == 0 ? h : name_hash(s + 1, n - 1, (h ^ lower(*s)) * 16777619u);
+        }
+
+        constexpr size_t name_slot(const char *s, size_t n)
+        {
+            return name_hash(s, n) >> (32 - SLOT_BITS);
+        }
+
+        constexpr size_t length(const char *s)
+        {
+            return *s == 0 ? 0 : 1 + length(s + 1);
+        }
+
+        //! Compile-time list of indices, for filling arrays with constexpr
+        //! functions (std::index_sequence is C++14).
+        template <size_t... I>
+        struct Indices
+        {
+        };
+
+        template <class A, class B>
+        struct JoinIndices;
+
+        template <size_t... I, size_t... J>
+        struct JoinIndices<Indices<I...>, Indices<J...>>
+        {
+            typedef Indices<I..., (sizeof...(I) + J)...> type;
+        };
+
+        //! Indices<0, ..., N - 1>, built by halves to keep the template
+        //! recursion shallow.
+        template <size_t N>
+        struct MakeIndices
+        {
+            typedef typename JoinIndices<typename MakeIndices<N / 2>::type,
+                                         typename MakeIndices<N - N / 2>::type>::type type;
+        };
+
+        template <>
+        struct MakeIndices<0>
+        {
+            typedef Indices<> type;
+        };
+
+        template <>
+        struct MakeIndices<1>
+        {
+            typedef Indices<0> type;
+        };
+
+        //! Array that constexpr functions can return.
+        template <class T, size_t N>
+        struct Table
+        {
+            T values[N];
+        };
+
+        template <size_t... I>
+        constexpr Table<size_t, sizeof...(I)> color_slots(Indices<I...>)
+        {
+            return {{name_slot(NAMED_COLORS[I].name, length(NAMED_COLORS[I].name))...}};
+        }
+
+        //! Hash slot of each named color.
+        constexpr Table<size_t, NAMED_COLOR_COUNT> COLOR_SLOTS = color_slots(MakeIndices<NAMED_COLOR_COUNT>::type());
+
+        //! Index + 1 of the first color hashed to a slot (0 if none).
+        constexpr unsigned char slot_entry(size_t slot, size_t i = 0)
+        {
+            return i == NAMED_COLOR_COUNT        ? 0
+                 : COLOR_SLOTS.values[i] == slot ? (unsigned char)(i + 1)
+                                                 : slot_entry(slot, i + 1);
+        }
+
+        template <size_t... I>
+        constexpr Table<unsigned char, sizeof...(I)> name_slots(Indices<I...>)
+        {
+            return {{slot_entry(I)...}};
+        }
+
+        //! Index + 1 of the color of each hash slot (0 for empty slots),
+        //! filled at compile time.
+        constexpr Table<unsigned char, 1 << SLOT_BITS> NAME_SLOTS = name_slots(MakeIndices<1 << SLOT_BITS>::type());
+
+        //! Check that no color shares its slot with an earlier one.
+        constexpr bool slots_match(size_t i)
+        {
+            return i == NAMED_COLOR_COUNT ||
+                   (NAME_SLOTS.values[COLOR_SLOTS.values[i]] == i + 1 && slots_match(i + 1));
+        }
+        static_assert(slots_match(0), "NAME_HASH_SEED gives two colors the same slot");
+
+
+        bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        int hex_digit(char c)
+        {
+            return c >= '0' && c <= '9' ? c - '0'
+                 : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                 : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                 : -1;
+        }
+
+        //! Decode "#rrggbb" or "#rgb" (s points past the '#').
+        bool parse_hex(const char *s, size_t n, Color &c)
+        {
+            int d[6];
+            if (n != 3 && n != 6)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                if ((d[i] = hex_digit(s[i])) < 0)
+                {
+                    return false;
+                }
+            }
+            if (n == 3)
+            {
+                c = {(rgb_value)(d[0] * 17), (rgb_value)(d[1] * 17), (rgb_value)(d[2] * 17)};
+            }
+            else
+            {
+                c = {(rgb_value)(d[0] << 4 | d[1]), (rgb_value)(d[2] << 4 | d[3]), (rgb_value)(d[4] << 4 | d[5])};
+            }
+            return true;
+        }
+
+        //! Decode one rgb() component: a number or a percentage, clamped
+        //! to [0, 255].
+        bool parse_component(const char *&p, const char *end, rgb_value &v)
+        {
+            bool negative = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                p++;
+            }
+            double value = 0;
+            bool any = false;
+            for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+            {
+                value = value * 10 + (*p - '0');
+            }
+            if (p < end && *p == '.')
+            {
+                double scale = 0.1;
+                for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true, scale /= 10)
+                {
+                    value += (*p - '0') * scale;
+                }
+            }
+            if (!any)
+            {
+                return false;
+            }
+            if (p < end && *p == '%')
+            {
+                value = value * 255 / 100;
+                p++;
+            }
+            value = negative ? 0 : value + 0.5;
+            v = (rgb_value)(value > 255 ? 255 : value);
+            return true;
+        }
+
+        //! Decode "rgb(r, g, b)" (commas or whitespace between components;
+        //! s points past the '(').
+        bool parse_rgb(const char *p, const char *end, Color &c)
+        {
+            rgb_value *components[3] = {&c.red, &c.green, &c.blue};
+            for (int i = 0; i < 3; i++)
+            {
+                while (p < end && is_space(*p))
+                {
+                    p++;
+                }
+                if (i > 0 && p < end && *p == ',')
+                {
+                    p++;
+                    while (p < end && is_space(*p))
+                    {
+                        p++;
+                    }
+                }
+                if (!parse_component(p, end, *components[i]))
+                {
+                    return false;
+                }
+            }
+            while (p < end && is_space(*p))
+            {
+                p++;
+            }
+            return p + 1 == end && *p == ')';
+        }
+
+        //! Look a color name up in the perfect hash table.
+        bool parse_name(const char *s, size_t n, Color &c)
+        {
+            unsigned char index = NAME_SLOTS.values[name_slot(s, n)];
+            if (index == 0)
+            {
+                return false;
+            }
+            const NamedColor &named = NAMED_COLORS[index - 1];
+            for (size_t i = 0; i < n; i++)
+            {
+                if (named.name[i] == 0 || lower(s[i]) != (uint32_t)named.name[i])
+                {
+                    return false;
+                }
+            }
+            if (named.name[n] != 0)
+            {
+                return false;
+            }
+            c = named.color;
+            return true;
+        }
+    }
+
+    Color parse_color(const char *str, size_t len)
     {
-        Color c;
-        if (str.at(0) == '#')
+        const char *begin = str, *end = str + len;
+        while (begin < end && is_space(*begin))
+        {
+            begin++;
+        }
+        while (end > begin && is_space(end[-1]))
+        {
+            end--;
+        }
+        size_t n = end - begin;
+        Color c = {0, 0, 0};
+        bool ok;
+        if (n > 0 && *begin == '#')
+        {
+            ok = parse_hex(begin + 1, n - 1, c);
+        }
+        else if (n >= 4 && lower(begin[0]) == 'r' && lower(begin[1]) == 'g' &&
+                 lower(begin[2]) == 'b' && begin[3] == '(')
         {
-            int v;
-            std::istringstream ss(str.substr(1));
-            ss >> std::hex >> v;
-            c.red = (v >> 16);
-            c.green = (v >> 8) & 0xFF;
-            c.blue = v & 0xFF;
+            ok = parse_rgb(begin + 4, end, c);
         }
         else
         {
-            c = NAMES_TO_COLORS.at(str);
+            ok = parse_name(begin, n, c);
+        }
+        if (!ok)
+        {
+            throw std::runtime_error("Invalid color: '" + std::string(str, len) + "'");
         }
         return c;
     }
-}
\ No newline at end of file
+
+    Color parse_color(const char *str)
+    {
+        return parse_color(str, ::strlen(str));
+    }
+
+    Color parse_color(const std::string &str)
+    {
+        return parse_color(str.data(), str.size());
+    }
+}
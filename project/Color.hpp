@@ -2,6 +2,7 @@
 #ifndef __svg_Color_hpp__
 #define __svg_Color_hpp__
 
+#include <cstddef>
 #include <string>
 
 namespace svg {
@@ -18,9 +19,21 @@ namespace svg {
   };
 
   //! Parse a color from a string.
-  //! The string may refer to a color name or have a
-  //! '#rrggbb' format where 'rr', 'gg' and 'bb' 
-  //! are hexadecimal values for each RGB component. 
+  //! The string may be one of the SVG/CSS color names (in any case),
+  //! or have a '#rrggbb' or '#rgb' format where 'r', 'g' and 'b'
+  //! are hexadecimal digits for each RGB component, or an
+  //! 'rgb(r, g, b)' format with numbers or percentages.
+  //! Surrounding whitespace is ignored; throws std::runtime_error
+  //! for anything else.
+  //! @param str String.
+  //! @param len String length.
+  //! @return A corresponding color.
+  Color parse_color(const char* str, size_t len);
+  //! Parse a color from a NUL-terminated string (see above).
+  //! @param str String.
+  //! @return A corresponding color.
+  Color parse_color(const char* str);
+  //! Parse a color from a string (see above).
   //! @param str String.
   //! @return A corresponding color.
   Color parse_color(const std::string& str);
@@ -0,0 +1,134 @@
+#include "Converter.hpp"
+
+#include <algorithm>
+
+namespace svg
+{
+    Converter::Converter()
+        : dimensions_({0, 0})
+    {
+    }
+
+    void Converter::clear()
+    {
+        elements_.clear();
+        arena_.reset();
+        list_.clear();
+    }
+
+    void Converter::load(const std::string &svg_file, const RenderOptions &options)
+    {
+        clear();
+        // Precompiled scenes are used as they are.
+        if (DisplayList::is_scene_file(svg_file))
+        {
+            list_.load(svg_file, dimensions_);
+            check_canvas(dimensions_, svg_file, options.max_pixels);
+            return;
+        }
+        loadSVG(svg_file, dimensions_, elements_, options, &arena_);
+        check_canvas(dimensions_, svg_file, options.max_pixels);
+        list_.compile(elements_);
+    }
+
+    void Converter::load(const char *svg_data, size_t size, const RenderOptions &options)
+    {
+        clear();
+        if (options.streaming)
+        {
+            streamSVG(svg_data, size, dimensions_, elements_, &arena_);
+        }
+        else
+        {
+            parseSVG(svg_data, size, dimensions_, elements_, &arena_);
+        }
+        check_canvas(dimensions_, "SVG document", options.max_pixels);
+        list_.compile(elements_);
+    }
+
+    void Converter::reset_image(int top, int rows)
+    {
+        if (image_)
+        {
+            image_->reset(dimensions_.x, dimensions_.y, top, rows);
+        }
+        else
+        {
+            image_.reset(new PNGImage(dimensions_.x, dimensions_.y, top, rows));
+        }
+    }
+
+    RenderStats Converter::render_image(const RenderOptions &options)
+    {
+        reset_image(0, dimensions_.y);
+        RenderStats stats = svg::render(list_, *image_, options);
+        stats.arena_bytes = arena_.bytes_used();
+        return stats;
+    }
+
+    RenderStats Converter::render_bands(const RenderOptions &options, PNGWriter &writer)
+    {
+        // Render and encode one band of rows at a time.
+        RenderStats stats;
+        for (int top = 0; top < dimensions_.y; top += options.band_rows)
+        {
+            int rows = std::min(options.band_rows, dimensions_.y - top);
+            reset_image(top, rows);
+            stats.occluded_writes += svg::render(list_, *image_, options).occluded_writes;
+            writer.write_rows(image_->row(top), rows);
+        }
+        writer.finish();
+        stats.arena_bytes = arena_.bytes_used();
+        return stats;
+    }
+
+    RenderStats Converter::convert(const std::string &svg_file, const std::string &png_file, const RenderOptions &options)
+    {
+        load(svg_file, options);
+        RenderStats stats;
+        if (options.band_rows > 0)
+        {
+            PNGWriter writer(png_file, dimensions_.x, dimensions_.y, options.compression);
+            stats = render_bands(options, writer);
+        }
+        else
+        {
+            stats = render_image(options);
+            image_->save(png_file, options.compression, options.threads, options.palette);
+        }
+        return stats;
+    }
+
+    const PNGImage &Converter::render(const std::string &svg_file, const RenderOptions &options, RenderStats *stats)
+    {
+        load(svg_file, options);
+        RenderStats s = render_image(options);
+        if (stats != nullptr)
+        {
+            *stats = s;
+        }
+        return *image_;
+    }
+
+    RenderStats Converter::convert_buffer(const char *svg_data, size_t size, const PNGSink &sink, const RenderOptions &options)
+    {
+        load(svg_data, size, options);
+        RenderStats stats;
+        if (options.band_rows > 0)
+        {
+            PNGWriter writer(sink, dimensions_.x, dimensions_.y, options.compression);
+            stats = render_bands(options, writer);
+        }
+        else
+        {
+            stats = render_image(options);
+            image_->encode(sink, options.compression, options.threads, options.palette);
+        }
+        return stats;
+    }
+
+    std::unique_ptr<PNGImage> Converter::release_image()
+    {
+        return std::move(image_);
+    }
+}
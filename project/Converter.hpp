@@ -0,0 +1,76 @@
+//! @file Converter.hpp
+#ifndef __svg_Converter_hpp__
+#define __svg_Converter_hpp__
+
+#include "SVGElements.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Converts documents one after the other, keeping the memory of the
+    //! previous conversion (the scene arena, display list and image
+    //! buffers) for the next one instead of allocating it again. A
+    //! converter is not thread-safe: use one per thread.
+    class Converter
+    {
+    public:
+        //! Constructor.
+        Converter();
+        Converter(const Converter &) = delete;
+        Converter &operator=(const Converter &) = delete;
+        //! Convert an SVG file (or scene file) to a PNG file.
+        //! @param svg_file Input file name.
+        //! @param png_file Output file name.
+        //! @param options Rendering options.
+        //! @return Rendering statistics.
+        RenderStats convert(const std::string &svg_file, const std::string &png_file, const RenderOptions &options);
+        //! Render an SVG file (or scene file) without saving it.
+        //! band_rows and the encoding options are ignored.
+        //! @param svg_file Input file name.
+        //! @param options Rendering options.
+        //! @param stats If not null, receives the rendering statistics.
+        //! @return The image, valid until the next conversion.
+        const PNGImage &render(const std::string &svg_file, const RenderOptions &options, RenderStats *stats = nullptr);
+        //! Convert an SVG document held in memory to PNG data.
+        //! @param svg_data Document contents.
+        //! @param size Size of the contents.
+        //! @param sink Output for the PNG data.
+        //! @param options Rendering options.
+        //! @return Rendering statistics.
+        RenderStats convert_buffer(const char *svg_data, size_t size, const PNGSink &sink, const RenderOptions &options);
+        //! Take ownership of the image of the last conversion (the next
+        //! conversion allocates a new one).
+        //! @return The image (null if none).
+        std::unique_ptr<PNGImage> release_image();
+
+    private:
+        //! Discard the previous document.
+        void clear();
+        //! Load a file into the document.
+        void load(const std::string &svg_file, const RenderOptions &options);
+        //! Load a document held in memory.
+        void load(const char *svg_data, size_t size, const RenderOptions &options);
+        //! Render the whole document into image_.
+        RenderStats render_image(const RenderOptions &options);
+        //! Render and encode the document one band of rows at a time.
+        RenderStats render_bands(const RenderOptions &options, PNGWriter &writer);
+        //! Reset image_ to a blank band (allocating it if needed).
+        void reset_image(int top, int rows);
+
+        //! Canvas size.
+        Point dimensions_;
+        //! Storage of the elements.
+        Arena arena_;
+        //! Top-level elements (in arena_).
+        std::vector<SVGElement *> elements_;
+        //! Compiled elements.
+        DisplayList list_;
+        //! Image, or band of the image.
+        std::unique_ptr<PNGImage> image_;
+    };
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include "DisplayList.hpp"
+#include "MappedFile.hpp"
+#include "SVGElements.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace svg
+{
+    namespace
+    {
+        //! Header of a binary scene file. It is followed by the command,
+        //! bounding box and point arrays, in the in-memory layout of the
+        //! platform that wrote the file (checked with byte_order and the
+        //! version, which changes whenever the layout does).
+        struct SceneHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t byte_order;
+            int32_t width;
+            int32_t height;
+            uint64_t commands;
+            uint64_t points;
+        };
+
+        const char SCENE_MAGIC[8] = {'S', 'V', 'G', 'S', 'C', 'E', 'N', 'E'};
+        const uint32_t SCENE_VERSION = 1;
+        const uint32_t SCENE_BYTE_ORDER = 0x01020304;
+        //! Largest canvas (in pixels) of a scene file; larger sizes are
+        //! taken for corruption.
+        const uint64_t SCENE_MAX_PIXELS = 1ULL << 30;
+
+        //! Check that an ellipse spans only representable coordinates, so
+        //! drawing it cannot overflow.
+        bool valid_ellipse(const Point &center, const Point &radius)
+        {
+            long long rx = std::llabs(radius.x), ry = std::llabs(radius.y);
+            return center.x - rx >= INT32_MIN && center.x + rx <= INT32_MAX &&
+                   center.y - ry >= INT32_MIN && center.y + ry <= INT32_MAX;
+        }
+
+        // The arrays are 4-byte aligned after the header, and so can be
+        // used in place from a mapping (which is page aligned).
+        static_assert(sizeof(SceneHeader) == 40, "unexpected scene header layout");
+        static_assert(sizeof(DisplayList::Command) == 12, "unexpected command layout");
+        static_assert(sizeof(BoundingBox) == 16, "unexpected bounding box layout");
+        static_assert(sizeof(Point) == 8, "unexpected point layout");
+    }
+
+    DisplayList::DisplayList()
+        : commands_(nullptr), bounds_(nullptr), points_(nullptr), size_(0)
+    {
+    }
+
+    DisplayList::DisplayList(const std::vector<SVGElement *> &elements)
+        : DisplayList()
+    {
+        compile(elements);
+    }
+
+    void DisplayList::compile(const std::vector<SVGElement *> &elements)
+    {
+        clear();
+        command_vector_.reserve(elements.size());
+        bounds_vector_.reserve(elements.size());
+        for (const SVGElement *e : elements)
+        {
+            e->compile(*this, Transform());
+        }
+    }
+
+    void DisplayList::clear()
+    {
+        command_vector_.clear();
+        bounds_vector_.clear();
+        point_vector_.clear();
+        file_.reset();
+        file_data_.clear();
+        use_vectors();
+    }
+
+    void DisplayList::use_vectors()
+    {
+        commands_ = command_vector_.data();
+        bounds_ = bounds_vector_.data();
+        points_ = point_vector_.data();
+        size_ = command_vector_.size();
+    }
+
+    bool DisplayList::is_scene_file(const std::string &file_name)
+    {
+        FILE *f = ::fopen(file_name.c_str(), "rb");
+        if (f == nullptr)
+        {
+            return false;
+        }
+        char magic[sizeof(SCENE_MAGIC)];
+        bool scene = ::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                     ::memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0;
+        ::fclose(f);
+        return scene;
+    }
+
+    void DisplayList::save(const std::string &file_name, const Point &dimensions) const
+    {
+        SceneHeader header;
+        ::memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+        header.version = SCENE_VERSION;
+        header.byte_order = SCENE_BYTE_ORDER;
+        header.width = dimensions.x;
+        header.height = dimensions.y;
+        header.commands = size_;
+        header.points = size_ == 0 ? 0 : commands_[size_ - 1].first + commands_[size_ - 1].count;
+        FILE *f = ::fopen(file_name.c_str(), "wb");
+        if (f == nullptr)
+        {
+            throw std::runtime_error("Unable to write " + file_name);
+        }
+        bool ok = ::fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  (size_ == 0 || (::fwrite(commands_, sizeof(Command), size_, f) == size_ &&
+                                  ::fwrite(bounds_, sizeof(BoundingBox), size_, f) == size_)) &&
+                  (header.points == 0 || ::fwrite(points_, sizeof(Point), header.points, f) == header.points);
+        ok = ::fclose(f) == 0 && ok;
+        if (!ok)
+        {
+            throw std::runtime_error("Unable to write " + file_name);
+        }
+    }
+
+    void DisplayList::load(const std::string &file_name, Point &dimensions)
+    {
+        std::shared_ptr<MappedFile> file(new MappedFile(file_name));
+        std::vector<char> file_data;
+        const char *data = file->data();
+        size_t size = file->size();
+        if (!file->valid())
+        {
+            // Read the file instead (vector memory is aligned for the arrays).
+            file.reset();
+            FILE *f = ::fopen(file_name.c_str(), "rb");
+            if (f == nullptr)
+            {
+                throw std::runtime_error("Unable to load " + file_name);
+            }
+            char buffer[1 << 16];
+            size_t n;
+            while ((n = ::fread(buffer, 1, sizeof(buffer), f)) > 0)
+            {
+                file_data.insert(file_data.end(), buffer, buffer + n);
+            }
+            bool failed = ::ferror(f) != 0;
+            ::fclose(f);
+            if (failed)
+            {
+                throw std::runtime_error("Unable to load " + file_name);
+            }
+            data = file_data.data();
+            size = file_data.size();
+        }
+
+        SceneHeader header;
+        if (size < sizeof(header))
+        {
+            throw std::runtime_error(file_name + ": not a scene file");
+        }
+        ::memcpy(&header, data, sizeof(header));
+        if (::memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0)
+        {
+            throw std::runtime_error(file_name + ": not a scene file");
+        }
+        if (header.version != SCENE_VERSION || header.byte_order != SCENE_BYTE_ORDER)
+        {
+            throw std::runtime_error(file_name + ": unsupported scene file version or byte order");
+        }
+        uint64_t body = size - sizeof(header);
+        if (header.width <= 0 || header.height <= 0 ||
+            (uint64_t)header.width * (uint64_t)header.height > SCENE_MAX_PIXELS ||
+            header.commands > body / (sizeof(Command) + sizeof(BoundingBox)) ||
+            header.points > UINT32_MAX ||
+            body != header.commands * (sizeof(Command) + sizeof(BoundingBox)) + header.points * sizeof(Point))
+        {
+            throw std::runtime_error(file_name + ": corrupt scene file");
+        }
+        const Command *commands = reinterpret_cast<const Command *>(data + sizeof(header));
+        const BoundingBox *bounds = reinterpret_cast<const BoundingBox *>(commands + header.commands);
+        const Point *points = reinterpret_cast<const Point *>(bounds + header.commands);
+        // Commands must stay within the points, so drawing cannot read
+        // past the file.
+        for (uint64_t i = 0; i < header.commands; i++)
+        {
+            const Command &cmd = commands[i];
+            if (cmd.kind > POLYGON || (uint64_t)cmd.first + cmd.count > header.points ||
+                ((cmd.kind == ELLIPSE || cmd.kind == LINE) && cmd.count != 2) ||
+                (cmd.kind == ELLIPSE && !valid_ellipse(points[cmd.first], points[cmd.first + 1])))
+            {
+                throw std::runtime_error(file_name + ": corrupt scene file");
+            }
+        }
+
+        command_vector_.clear();
+        bounds_vector_.clear();
+        point_vector_.clear();
+        file_ = file;
+        file_data_.swap(file_data);
+        commands_ = commands;
+        bounds_ = bounds;
+        points_ = points;
+        size_ = header.commands;
+        dimensions.x = header.width;
+        dimensions.y = header.height;
+    }
+
+    Point *DisplayList::append(Kind kind, const Color &color, size_t n)
+    {
+        if (file_ || !file_data_.empty())
+        {
+            throw std::logic_error("Cannot add to a loaded display list");
+        }
+        if (point_vector_.size() + n > UINT32_MAX)
+        {
+            throw std::runtime_error("Too many points in display list");
+        }
+        Command cmd;
+        cmd.kind = kind;
+        cmd.color = color;
+        cmd.first = (uint32_t)point_vector_.size();
+        cmd.count = (uint32_t)n;
+        command_vector_.push_back(cmd);
+        bounds_vector_.push_back({{0, 0}, {-1, -1}});
+        point_vector_.resize(point_vector_.size() + n);
+        use_vectors();
+        return point_vector_.data() + cmd.first;
+    }
+
+    void DisplayList::add_ellipse(const Color &fill, const Point &center, const Point &radius)
+    {
+        Point *p = append(ELLIPSE, fill, 2);
+        p[0] = center;
+        p[1] = radius;
+        int rx = std::abs(radius.x), ry = std::abs(radius.y);
+        bounds_vector_.back() = {{center.x - rx, center.y - ry}, {center.x + rx, center.y + ry}};
+    }
+
+    void DisplayList::add_line(const Color &stroke, const Point &a, const Point &b)
+    {
+        Point *p = append(LINE, stroke, 2);
+        p[0] = a;
+        p[1] = b;
+        bounds_vector_.back() = BoundingBox::of(p, 2);
+    }
+
+    void DisplayList::add_polyline(const Color &stroke, const Point *points, size_t n, const Transform &t)
+    {
+        Point *p = append(POLYLINE, stroke, n);
+        t.apply(points, p, n);
+        bounds_vector_.back() = BoundingBox::of(p, n);
+    }
+
+    void DisplayList::add_polygon(const Color &fill, const Point *points, size_t n, const Transform &t)
+    {
+        Point *p = append(POLYGON, fill, n);
+        t.apply(points, p, n);
+        bounds_vector_.back() = BoundingBox::of(p, n);
+    }
+
+    size_t DisplayList::size() const
+    {
+        return size_;
+    }
+
+    const DisplayList::Command &DisplayList::command(size_t i) const
+    {
+        return commands_[i];
+    }
+
+    const BoundingBox &DisplayList::bounds(size_t i) const
+    {
+        return bounds_[i];
+    }
+
+    void DisplayList::draw(size_t i, PNGImage &img) const
+    {
+        const Command &cmd = commands_[i];
+        const Point *p = points_ + cmd.first;
+        switch (cmd.kind)
+        {
+        case ELLIPSE:
+            img.draw_ellipse(p[0], p[1], cmd.color);
+            break;
+        case LINE:
+            img.draw_line(p[0], p[1], cmd.color);
+            break;
+        case POLYLINE:
+            for (uint32_t j = 1; j < cmd.count; j++)
+            {
+                img.draw_line(p[j - 1], p[j], cmd.color);
+            }
+            break;
+        case POLYGON:
+            img.draw_polygon(p, cmd.count, cmd.color);
+            break;
+        }
+    }
+}
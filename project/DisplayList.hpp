@@ -0,0 +1,146 @@
+//! @file DisplayList.hpp
+#ifndef __svg_DisplayList_hpp__
+#define __svg_DisplayList_hpp__
+
+#include "Color.hpp"
+#include "Point.hpp"
+#include "PNGImage.hpp"
+#include "Transform.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    class SVGElement;
+    class MappedFile;
+
+    //! Flat, render-ready form of a document: one packed array of drawing
+    //! commands in document order, with the (already transformed) points
+    //! of every command in a single shared buffer. Drawing it is a loop
+    //! over the commands, without virtual calls or per-element objects.
+    //!
+    //! A list can be saved as a binary scene file, holding the same arrays
+    //! after a small header, and loaded back without parsing: the arrays
+    //! are used in place from a memory mapping of the file.
+    class DisplayList
+    {
+    public:
+        //! Kind of primitive drawn by a command.
+        enum Kind : unsigned char
+        {
+            ELLIPSE,  //!< Points are the center and the radius.
+            LINE,     //!< Points are the two ends.
+            POLYLINE, //!< Points are the vertices.
+            POLYGON   //!< Points are the vertices.
+        };
+        //! A drawing command.
+        struct Command
+        {
+            //! Primitive.
+            Kind kind;
+            //! Fill or stroke color.
+            Color color;
+            //! Index of the first point in the point buffer.
+            uint32_t first;
+            //! Number of points.
+            uint32_t count;
+        };
+        //! Constructor of an empty list.
+        DisplayList();
+        //! Constructor that compiles a sequence of elements.
+        //! @param elements Elements, in document order.
+        DisplayList(const std::vector<SVGElement *> &elements);
+        DisplayList(const DisplayList &) = delete;
+        DisplayList &operator=(const DisplayList &) = delete;
+        DisplayList(DisplayList &&) = default;
+        DisplayList &operator=(DisplayList &&) = default;
+        //! Replace the contents with the compiled elements, reusing the
+        //! memory of the list.
+        //! @param elements Elements, in document order.
+        void compile(const std::vector<SVGElement *> &elements);
+        //! Remove all commands.
+        void clear();
+        //! Check whether a file is a binary scene file (by its header).
+        //! @param file_name File name.
+        //! @return Whether it is.
+        static bool is_scene_file(const std::string &file_name);
+        //! Save as a binary scene file.
+        //! Throws std::runtime_error if the file cannot be written.
+        //! @param file_name File name.
+        //! @param dimensions Canvas size.
+        void save(const std::string &file_name, const Point &dimensions) const;
+        //! Replace the contents with those of a binary scene file.
+        //! Throws std::runtime_error if the file cannot be read, was
+        //! written by an incompatible version or platform, or is corrupt.
+        //! @param file_name File name.
+        //! @param dimensions Receives the canvas size.
+        void load(const std::string &file_name, Point &dimensions);
+        //! Append an ellipse.
+        //! @param fill Fill color.
+        //! @param center Center (transformed).
+        //! @param radius Radius in X and Y axis (transformed).
+        void add_ellipse(const Color &fill, const Point &center, const Point &radius);
+        //! Append a line.
+        //! @param stroke Stroke color.
+        //! @param a First end (transformed).
+        //! @param b Second end (transformed).
+        void add_line(const Color &stroke, const Point &a, const Point &b);
+        //! Append a polyline, mapping its points.
+        //! @param stroke Stroke color.
+        //! @param points Vertices.
+        //! @param n Number of vertices.
+        //! @param t Transformation to apply to the vertices.
+        void add_polyline(const Color &stroke, const Point *points, size_t n, const Transform &t);
+        //! Append a polygon, mapping its points.
+        //! @param fill Fill color.
+        //! @param points Vertices.
+        //! @param n Number of vertices.
+        //! @param t Transformation to apply to the vertices.
+        void add_polygon(const Color &fill, const Point *points, size_t n, const Transform &t);
+        //! Get the number of commands.
+        //! @return The number of commands.
+        size_t size() const;
+        //! Get a command.
+        //! @param i Command index.
+        //! @return The command.
+        const Command &command(size_t i) const;
+        //! Get the box covering every pixel a command may draw (without
+        //! anti-aliasing).
+        //! @param i Command index.
+        //! @return The bounding box.
+        const BoundingBox &bounds(size_t i) const;
+        //! Draw a command.
+        //! @param i Command index.
+        //! @param img Image to draw into.
+        void draw(size_t i, PNGImage &img) const;
+
+    private:
+        //! Append a command and reserve room for its points.
+        //! @return The first point of the command.
+        Point *append(Kind kind, const Color &color, size_t n);
+        //! Point the arrays at the owned vectors.
+        void use_vectors();
+
+        //! Commands, in document order.
+        const Command *commands_;
+        //! Bounding box of each command.
+        const BoundingBox *bounds_;
+        //! Points of all commands.
+        const Point *points_;
+        //! Number of commands.
+        size_t size_;
+        //! Storage of a list that was built (empty for a loaded list).
+        std::vector<Command> command_vector_;
+        std::vector<BoundingBox> bounds_vector_;
+        std::vector<Point> point_vector_;
+        //! Storage of a loaded list: the mapped file, or its contents when
+        //! it cannot be mapped.
+        std::shared_ptr<MappedFile> file_;
+        std::vector<char> file_data_;
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include "MappedFile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SVG_HAVE_MMAP 1
+#endif
+
+namespace svg
+{
+    MappedFile::MappedFile(const std::string &file_name)
+        : data_(nullptr), size_(0)
+    {
+#ifdef SVG_HAVE_MMAP
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void *p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data_ = p;
+                size_ = (size_t)st.st_size;
+                // Only a hint: read ahead aggressively, drop pages behind.
+                ::madvise(data_, size_, MADV_SEQUENTIAL);
+            }
+        }
+        // The mapping stays valid after the descriptor is closed.
+        ::close(fd);
+#else
+        (void)file_name;
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifdef SVG_HAVE_MMAP
+        if (data_ != nullptr)
+        {
+            ::munmap(data_, size_);
+        }
+#endif
+    }
+
+    bool MappedFile::valid() const
+    {
+        return data_ != nullptr;
+    }
+
+    const char *MappedFile::data() const
+    {
+        return (const char *)data_;
+    }
+
+    size_t MappedFile::size() const
+    {
+        return size_;
+    }
+}
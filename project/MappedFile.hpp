@@ -0,0 +1,41 @@
+//! @file MappedFile.hpp
+#ifndef __svg_MappedFile_hpp__
+#define __svg_MappedFile_hpp__
+
+#include <cstddef>
+#include <string>
+
+namespace svg
+{
+    //! Read-only memory mapping of a whole file, advised for sequential
+    //! access. Mapping may fail (missing file, empty file, special files,
+    //! platforms without mmap); callers then fall back to reading the
+    //! file normally.
+    class MappedFile
+    {
+    public:
+        //! Constructor that maps a file.
+        //! @param file_name File name.
+        MappedFile(const std::string &file_name);
+        //! Destructor (unmaps the file).
+        ~MappedFile();
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        //! Check whether the file is mapped.
+        //! @return Whether it is.
+        bool valid() const;
+        //! Get the file contents.
+        //! @return Pointer to the first byte (null when not mapped).
+        const char *data() const;
+        //! Get the file size.
+        //! @return The size in bytes.
+        size_t size() const;
+
+    private:
+        //! Mapped contents.
+        void *data_;
+        //! Mapped size.
+        size_t size_;
+    };
+}
+#endif
@@ -4,12 +4,26 @@
 
 #include "Color.hpp"
 #include "Point.hpp"
+#include "PNGWriter.hpp"
 
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace svg
 {
+    //! Result of comparing two images.
+    struct ImageDiff
+    {
+        //! Number of pixels with a channel differing by more than the
+        //! tolerance.
+        unsigned long long mismatches = 0;
+        //! Bounding box of those pixels (empty when there are none).
+        BoundingBox bounds = {{0, 0}, {-1, -1}};
+        //! Largest difference of a channel over all pixels.
+        int max_delta = 0;
+    };
+
     //! PNG image.
     class PNGImage
     {
@@ -22,14 +36,64 @@ namespace svg
         //! @param w Image width.
         //! @param h Image height.
         PNGImage(int w, int h);
+        //! Constructor of a blank horizontal band of a taller image.
+        //! Only rows [top, top + rows) are stored and drawable, but
+        //! coordinates (and height()) refer to the whole image.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param top First row of the band.
+        //! @param rows Number of rows in the band.
+        PNGImage(int w, int h, int top, int rows);
+        //! Constructor of a view over the pixels of another image.
+        //! Drawing through the view only touches pixels inside the clip
+        //! box; the pixels stay owned by the other image.
+        //! @param image Image to draw into.
+        //! @param clip Clip box (intersected with the image bounds).
+        PNGImage(PNGImage &image, const BoundingBox &clip);
         //! Destructor.
         ~PNGImage();
+        //! Make the image a blank band of a (possibly different) image, as
+        //! if newly constructed, reusing the pixel memory when it is large
+        //! enough. Only for images that own their pixels.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param top First row of the band.
+        //! @param rows Number of rows in the band.
+        void reset(int w, int h, int top, int rows);
         //! Get image width.
         //! @return The image width.
         int width() const;
         //! Get image height.
         //! @return The image height.
         int height() const;
+        //! Get the pixels of a row.
+        //! @param y Y position (within the stored rows).
+        //! @return Pointer to the first of width() pixels.
+        const Color *row(int y) const;
+        //! Get the box that drawing operations are clipped to.
+        //! @return The clip box.
+        const BoundingBox &clip() const;
+        //! Enable or disable anti-aliased drawing.
+        //! When enabled, lines, polygons and ellipses are blended into
+        //! the image using their analytic per-pixel coverage.
+        //! @param on Whether to anti-alias.
+        void set_antialiasing(bool on);
+        //! Check if anti-aliased drawing is enabled.
+        //! @return true if enabled.
+        bool antialiasing() const;
+        //! Enable or disable front-to-back drawing.
+        //! When enabled, a pixel keeps the first color written to it and
+        //! later writes are skipped, so opaque elements can be drawn from
+        //! the topmost one down without overdraw. Enabling it clears the
+        //! coverage state of the image (views share it).
+        //! @param on Whether to draw front to back.
+        void set_front_to_back(bool on);
+        //! Check if front-to-back drawing is enabled.
+        //! @return true if enabled.
+        bool front_to_back() const;
+        //! Get the number of pixel writes skipped by front-to-back drawing.
+        //! @return Skipped pixel writes.
+        unsigned long long occluded_writes() const;
         //! Get mutable reference to image pixel.
         //! @param x X position
         //! @param y Y position.
@@ -42,16 +106,48 @@ namespace svg
         Color at(int x, int y) const;
         //! Save to output file.
         //! @param png_file_name Output file name.
-        void save(const std::string &png_file_name) const;
+        //! @param level zlib compression level, from 1 (fastest) to 9 (smallest).
+        //! @param threads Number of encoding threads.
+        //! @param palette Whether to write an indexed PNG when the image
+        //! has at most 256 colors.
+        void save(const std::string &png_file_name, int level = 6, int threads = 1,
+                  bool palette = false) const;
+        //! Compare with another image of the same size, row by row.
+        //! @param other Image to compare with.
+        //! @param tolerance Largest per-channel difference still
+        //! considered a match.
+        //! @param diff If not null, an image of the same size that
+        //! receives the mismatching pixels in red and the others in white.
+        //! @return The differences found.
+        ImageDiff compare(const PNGImage &other, int tolerance = 0, PNGImage *diff = nullptr) const;
+        //! Encode as PNG to a sink (same parameters as save).
+        //! @param sink Output.
+        void encode(const PNGSink &sink, int level = 6, int threads = 1,
+                    bool palette = false) const;
+        //! Encode as PNG in memory (same parameters as save).
+        //! @return The PNG file contents.
+        std::vector<unsigned char> encode(int level = 6, int threads = 1,
+                                          bool palette = false) const;
         //! Draw a line defined by 2 points.
         //! @param a First point.
         //! @param b Second point.
         //! @param c Color to use for the line.
         void draw_line(const Point &a, const Point &b, const Color &c);
+        //! Fill a horizontal run of pixels.
+        //! @param y Row.
+        //! @param x0 First column (inclusive).
+        //! @param x1 Last column (inclusive), may be less than x0.
+        //! @param c Color to use for the span.
+        void fill_span(int y, int x0, int x1, const Color &c);
         //! Draw a polygon.
         //! @param points Vector of points defining the polygon.
         //! @param fill Color to use for the polygon fill.
         void draw_polygon(const std::vector<Point> &points, const Color &fill);
+        //! Draw a polygon stored in an array.
+        //! @param points Points defining the polygon.
+        //! @param n Number of points.
+        //! @param fill Color to use for the polygon fill.
+        void draw_polygon(const Point *points, size_t n, const Color &fill);
         //! Draw an ellipse.
         //! @param center Coordinates for the ellipse center.
         //! @param radius Radius in X and Y axis.
@@ -60,12 +156,45 @@ namespace svg
         void draw_ellipse(const Point &center, const Point &radius, const Color &fill);
 
     private:
+        struct Occlusion;
+        //! Set a pixel if it lies inside the clip box.
+        //! @param x X position
+        //! @param y Y position.
+        //! @param c Color.
+        void plot(int x, int y, const Color &c);
+        //! Blend a closed path into the image by its coverage.
+        //! Coverage is accumulated per scanline (signed area) and
+        //! resolved with a single prefix-sum pass over each row.
+        //! @param xy Interleaved x, y vertex coordinates, in pixel units
+        //! where pixel (i, j) covers [i, i + 1) x [j, j + 1).
+        //! @param c Color to blend.
+        void fill_path(const std::vector<double> &xy, const Color &c);
+        //! Anti-aliased version of draw_line.
+        void draw_line_aa(const Point &a, const Point &b, const Color &c);
+        //! Anti-aliased version of draw_polygon.
+        void draw_polygon_aa(const Point *points, size_t count, const Color &c);
+        //! Anti-aliased version of draw_ellipse.
+        void draw_ellipse_aa(const Point &center, const Point &radius, const Color &c);
         //! Width.
         int width_;
         //! Height.
         int height_;
+        //! First stored row.
+        int top_;
+        //! Number of stored rows.
+        int rows_;
         //! Pixels.
         Color *pixels_;
+        //! Number of pixels allocated.
+        size_t capacity_;
+        //! Clip box for drawing operations.
+        BoundingBox clip_;
+        //! Whether pixels_ is owned (and freed) by this image.
+        bool owner_;
+        //! Whether drawing is anti-aliased.
+        bool antialias_;
+        //! Coverage state for front-to-back drawing (null when disabled).
+        std::shared_ptr<Occlusion> occlusion_;
     };
 }
 
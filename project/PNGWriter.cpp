@@ -0,0 +1,536 @@
+#include "PNGWriter.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <zlib.h>
+
+namespace svg
+{
+    namespace
+    {
+        //! Size of the IDAT chunks written.
+        const size_t IDAT_SIZE = 1 << 16;
+        //! Size of the blocks of image data compressed independently by
+        //! write_png (like pigz).
+        const size_t BLOCK_SIZE = 1 << 17;
+        //! Size of the deflate window, carried over between blocks.
+        const size_t WINDOW_SIZE = 1 << 15;
+
+        //! Run a job for every index in [0, n) on a number of threads.
+        template <typename Job>
+        void parallel_for(size_t n, int threads, const Job &job)
+        {
+            std::atomic<size_t> next(0);
+            auto worker = [&]()
+            {
+                size_t i;
+                while ((i = next++) < n)
+                {
+                    job(i);
+                }
+            };
+            std::vector<std::thread> pool;
+            for (int i = 1; i < threads && (size_t)i < n; i++)
+            {
+                pool.emplace_back(worker);
+            }
+            worker();
+            for (std::thread &th : pool)
+            {
+                th.join();
+            }
+        }
+
+        //! Store a 32-bit big-endian value.
+        void put_u32(unsigned char *p, unsigned v)
+        {
+            p[0] = (unsigned char)(v >> 24);
+            p[1] = (unsigned char)(v >> 16);
+            p[2] = (unsigned char)(v >> 8);
+            p[3] = (unsigned char)v;
+        }
+
+        //! Paeth predictor.
+        int paeth(int a, int b, int c)
+        {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc)
+            {
+                return a;
+            }
+            return pb <= pc ? b : c;
+        }
+
+        //! Filter a row with every PNG filter type and keep the one with
+        //! the smallest sum of absolute (signed) residuals, the usual
+        //! heuristic.
+        //! @param line Raw row.
+        //! @param prev Raw previous row (zeros for the first row).
+        //! @param stride Row size in bytes.
+        //! @param scratch Space for 5 filtered rows of stride + 1 bytes.
+        //! @return The chosen filtered row, starting with its filter type.
+        unsigned char *filter_row(const unsigned char *line, const unsigned char *prev,
+                                  size_t stride, unsigned char *scratch)
+        {
+            unsigned char *best = scratch;
+            long best_sum = -1;
+            for (int type = 0; type < 5; type++)
+            {
+                unsigned char *out = scratch + type * (stride + 1);
+                out[0] = (unsigned char)type;
+                long sum = 0;
+                for (size_t i = 0; i < stride; i++)
+                {
+                    int a = i >= 3 ? line[i - 3] : 0;
+                    int b = prev[i];
+                    int c = i >= 3 ? prev[i - 3] : 0;
+                    int pred = 0;
+                    switch (type)
+                    {
+                    case 1: pred = a; break;
+                    case 2: pred = b; break;
+                    case 3: pred = (a + b) >> 1; break;
+                    case 4: pred = paeth(a, b, c); break;
+                    }
+                    out[i + 1] = (unsigned char)(line[i] - pred);
+                    sum += std::abs((signed char)out[i + 1]);
+                }
+                if (best_sum < 0 || sum < best_sum)
+                {
+                    best_sum = sum;
+                    best = out;
+                }
+            }
+            return best;
+        }
+
+        //! Write a PNG chunk.
+        //! @param sink Output.
+        //! @param type Chunk type (4 characters).
+        //! @param data Chunk data.
+        //! @param len Data length.
+        void write_chunk(const PNGSink &sink, const char *type,
+                         const unsigned char *data, size_t len)
+        {
+            unsigned char header[8];
+            put_u32(header, (unsigned)len);
+            ::memcpy(header + 4, type, 4);
+            uLong crc = ::crc32(0, header + 4, 4);
+            if (len > 0)
+            {
+                crc = ::crc32(crc, data, (uInt)len);
+            }
+            unsigned char trailer[4];
+            put_u32(trailer, (unsigned)crc);
+            sink(header, 8);
+            if (len > 0)
+            {
+                sink(data, len);
+            }
+            sink(trailer, 4);
+        }
+
+        //! Write the PNG signature and header chunk.
+        //! @param depth Bits per sample (or per palette index).
+        //! @param color_type 2 for truecolor, 3 for indexed.
+        void write_header(const PNGSink &sink, int w, int h, int depth = 8, int color_type = 2)
+        {
+            static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+            sink(signature, 8);
+            unsigned char ihdr[13];
+            put_u32(ihdr, w);
+            put_u32(ihdr + 4, h);
+            ihdr[8] = (unsigned char)depth;
+            ihdr[9] = (unsigned char)color_type;
+            ihdr[10] = 0; // deflate
+            ihdr[11] = 0; // adaptive filtering
+            ihdr[12] = 0; // no interlace
+            write_chunk(sink, "IHDR", ihdr, 13);
+        }
+
+        //! Make a sink writing to a file.
+        PNGSink file_sink(FILE *file, const std::string &file_name)
+        {
+            return [file, file_name](const unsigned char *data, size_t len)
+            {
+                if (::fwrite(data, 1, len, file) != len)
+                {
+                    throw std::runtime_error(file_name + ": write failed!");
+                }
+            };
+        }
+
+        //! Filter truecolor rows in parallel; each row only needs the raw
+        //! row above.
+        std::vector<unsigned char> filter_rgb(const Color *pixels, int w, int h, int threads)
+        {
+            size_t stride = (size_t)w * 3;
+            std::vector<unsigned char> filtered((stride + 1) * h);
+            const int ROWS_PER_JOB = 64;
+            std::vector<unsigned char> zeros(stride, 0);
+            parallel_for((h + ROWS_PER_JOB - 1) / ROWS_PER_JOB, threads, [&](size_t job)
+            {
+                std::vector<unsigned char> scratch(5 * (stride + 1));
+                int y_end = std::min(h, (int)(job + 1) * ROWS_PER_JOB);
+                for (int y = (int)job * ROWS_PER_JOB; y < y_end; y++)
+                {
+                    const unsigned char *line = (const unsigned char *)(pixels + (size_t)y * w);
+                    const unsigned char *prev = y > 0 ? line - stride : zeros.data();
+                    ::memcpy(&filtered[y * (stride + 1)],
+                             filter_row(line, prev, stride, scratch.data()), stride + 1);
+                }
+            });
+            return filtered;
+        }
+
+        //! Map the pixels of an image to indexes in a palette of at most
+        //! 256 colors, in order of first appearance.
+        //! @param indexes Receives one index per pixel.
+        //! @param palette Receives the palette (3 bytes per color).
+        //! @return Whether the image has few enough colors.
+        bool index_colors(const Color *pixels, size_t count,
+                          std::vector<unsigned char> &indexes,
+                          std::vector<unsigned char> &palette)
+        {
+            // Open addressing table of packed colors (tagged so that 0
+            // means empty), sized to stay at most a quarter full.
+            const unsigned TABLE_SIZE = 1024;
+            unsigned keys[TABLE_SIZE] = {};
+            unsigned char values[TABLE_SIZE];
+            indexes.resize(count);
+            palette.clear();
+            unsigned last_key = 0;
+            unsigned char last_index = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                const Color &c = pixels[i];
+                unsigned key = 0x1000000u | (unsigned)c.red << 16 | (unsigned)c.green << 8 | c.blue;
+                if (key != last_key)
+                {
+                    unsigned slot = (key * 2654435761u) >> 22;
+                    while (keys[slot] != 0 && keys[slot] != key)
+                    {
+                        slot = (slot + 1) & (TABLE_SIZE - 1);
+                    }
+                    if (keys[slot] == 0)
+                    {
+                        if (palette.size() == 256 * 3)
+                        {
+                            return false;
+                        }
+                        keys[slot] = key;
+                        values[slot] = (unsigned char)(palette.size() / 3);
+                        palette.push_back(c.red);
+                        palette.push_back(c.green);
+                        palette.push_back(c.blue);
+                    }
+                    last_key = key;
+                    last_index = values[slot];
+                }
+                indexes[i] = last_index;
+            }
+            return true;
+        }
+
+        //! Pack palette indexes into rows of the given bit depth, each
+        //! preceded by filter type 0 (as recommended for indexed images).
+        std::vector<unsigned char> pack_indexes(const std::vector<unsigned char> &indexes,
+                                                int w, int h, int depth)
+        {
+            size_t stride = ((size_t)w * depth + 7) / 8;
+            std::vector<unsigned char> packed((stride + 1) * h, 0);
+            int per_byte = 8 / depth;
+            for (int y = 0; y < h; y++)
+            {
+                const unsigned char *in = &indexes[(size_t)y * w];
+                unsigned char *out = &packed[y * (stride + 1) + 1];
+                if (depth == 8)
+                {
+                    ::memcpy(out, in, w);
+                    continue;
+                }
+                for (int x = 0; x < w; x++)
+                {
+                    int shift = 8 - depth * (x % per_byte + 1);
+                    out[x / per_byte] |= (unsigned char)(in[x] << shift);
+                }
+            }
+            return packed;
+        }
+
+        //! Deflate image data into a zlib stream, in blocks compressed on
+        //! several threads (like pigz).
+        std::vector<unsigned char> deflate_blocks(const std::vector<unsigned char> &filtered,
+                                                  int level, int threads)
+        {
+            // Compress blocks in parallel as raw deflate streams, each primed
+            // with the preceding 32 KiB so matches may reach into the previous
+            // block. Non-final blocks end with a sync flush (byte aligned), so
+            // they concatenate into a single stream.
+            size_t total = filtered.size();
+            size_t blocks = std::max<size_t>(1, (total + BLOCK_SIZE - 1) / BLOCK_SIZE);
+            std::vector<std::vector<unsigned char>> compressed(blocks);
+            std::vector<uLong> checksums(blocks);
+            std::atomic<bool> failed(false);
+            parallel_for(blocks, threads, [&](size_t i)
+            {
+                size_t begin = i * BLOCK_SIZE;
+                size_t len = std::min(BLOCK_SIZE, total - begin);
+                unsigned char *data = const_cast<unsigned char *>(filtered.data()) + begin;
+                checksums[i] = ::adler32(::adler32(0, nullptr, 0), data, (uInt)len);
+                z_stream zs = z_stream();
+                if (::deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                {
+                    failed = true;
+                    return;
+                }
+                if (begin > 0)
+                {
+                    size_t dict = std::min(WINDOW_SIZE, begin);
+                    ::deflateSetDictionary(&zs, data - dict, (uInt)dict);
+                }
+                std::vector<unsigned char> &out = compressed[i];
+                out.resize(::deflateBound(&zs, (uLong)len) + 16);
+                zs.next_in = data;
+                zs.avail_in = (uInt)len;
+                zs.next_out = out.data();
+                zs.avail_out = (uInt)out.size();
+                int flush = i + 1 == blocks ? Z_FINISH : Z_SYNC_FLUSH;
+                int r = ::deflate(&zs, flush);
+                if ((flush == Z_FINISH && r != Z_STREAM_END) || (flush != Z_FINISH && r != Z_OK) ||
+                    zs.avail_in != 0)
+                {
+                    failed = true;
+                }
+                out.resize(out.size() - zs.avail_out);
+                ::deflateEnd(&zs);
+            });
+            if (failed)
+            {
+                throw std::runtime_error("PNG compression failed!");
+            }
+
+            // zlib wrapper: header, the concatenated blocks, Adler-32 of all data.
+            std::vector<unsigned char> stream;
+            unsigned cmf = 0x78;
+            unsigned flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+            unsigned flg = flevel << 6;
+            flg += 31 - (cmf * 256 + flg) % 31;
+            stream.push_back((unsigned char)cmf);
+            stream.push_back((unsigned char)flg);
+            uLong adler = ::adler32(0, nullptr, 0);
+            for (size_t i = 0; i < blocks; i++)
+            {
+                stream.insert(stream.end(), compressed[i].begin(), compressed[i].end());
+                size_t len = std::min(BLOCK_SIZE, total - i * BLOCK_SIZE);
+                adler = ::adler32_combine(adler, checksums[i], (z_off_t)len);
+                std::vector<unsigned char>().swap(compressed[i]);
+            }
+            unsigned char trailer[4];
+            put_u32(trailer, (unsigned)adler);
+            stream.insert(stream.end(), trailer, trailer + 4);
+            return stream;
+        }
+    }
+
+    PNGWriter::PNGWriter(const std::string &png_file_name, int w, int h, int level)
+        : file_name_(png_file_name), file_(nullptr), width_(w), height_(h), rows_written_(0),
+          finished_(true), zs_(new z_stream()), prev_((size_t)w * 3, 0),
+          filtered_(5 * ((size_t)w * 3 + 1)), out_(IDAT_SIZE)
+    {
+        file_ = ::fopen(png_file_name.c_str(), "wb");
+        if (file_ == nullptr)
+        {
+            throw std::runtime_error(png_file_name + ": could not open for writing!");
+        }
+        sink_ = file_sink(file_, file_name_);
+        try
+        {
+            start(level);
+        }
+        catch (...)
+        {
+            ::fclose(file_);
+            throw;
+        }
+    }
+
+    PNGWriter::PNGWriter(const PNGSink &sink, int w, int h, int level)
+        : file_name_("PNG output"), sink_(sink), file_(nullptr), width_(w), height_(h),
+          rows_written_(0), finished_(true), zs_(new z_stream()), prev_((size_t)w * 3, 0),
+          filtered_(5 * ((size_t)w * 3 + 1)), out_(IDAT_SIZE)
+    {
+        start(level);
+    }
+
+    void PNGWriter::start(int level)
+    {
+        if (::deflateInit(zs_.get(), level) != Z_OK)
+        {
+            throw std::runtime_error(file_name_ + ": could not initialize compressor!");
+        }
+        finished_ = false;
+        write_header(sink_, width_, height_);
+        zs_->next_out = out_.data();
+        zs_->avail_out = (uInt)out_.size();
+    }
+
+    PNGWriter::~PNGWriter()
+    {
+        if (!finished_)
+        {
+            ::deflateEnd(zs_.get());
+        }
+        if (file_ != nullptr)
+        {
+            ::fclose(file_);
+        }
+    }
+
+    void PNGWriter::write_chunk(const char *type, const unsigned char *data, size_t len)
+    {
+        svg::write_chunk(sink_, type, data, len);
+    }
+
+    void PNGWriter::compress(int flush)
+    {
+        for (;;)
+        {
+            int r = ::deflate(zs_.get(), flush);
+            if (r == Z_STREAM_ERROR)
+            {
+                throw std::runtime_error(file_name_ + ": compression failed!");
+            }
+            if (zs_->avail_out == 0)
+            {
+                write_chunk("IDAT", out_.data(), out_.size());
+                zs_->next_out = out_.data();
+                zs_->avail_out = (uInt)out_.size();
+                continue;
+            }
+            if (flush == Z_NO_FLUSH ? zs_->avail_in == 0 : r == Z_STREAM_END)
+            {
+                return;
+            }
+        }
+    }
+
+    void PNGWriter::write_rows(const Color *pixels, int rows)
+    {
+        size_t stride = (size_t)width_ * 3;
+        for (int y = 0; y < rows && rows_written_ < height_; y++, rows_written_++)
+        {
+            const unsigned char *line = (const unsigned char *)(pixels + (size_t)y * width_);
+            zs_->next_in = filter_row(line, prev_.data(), stride, filtered_.data());
+            zs_->avail_in = (uInt)(stride + 1);
+            compress(Z_NO_FLUSH);
+            ::memcpy(prev_.data(), line, stride);
+        }
+    }
+
+    void PNGWriter::finish()
+    {
+        if (finished_)
+        {
+            return;
+        }
+        if (rows_written_ != height_)
+        {
+            throw std::runtime_error(file_name_ + ": missing image rows!");
+        }
+        zs_->avail_in = 0;
+        compress(Z_FINISH);
+        size_t pending = out_.size() - zs_->avail_out;
+        if (pending > 0)
+        {
+            write_chunk("IDAT", out_.data(), pending);
+        }
+        write_chunk("IEND", nullptr, 0);
+        ::deflateEnd(zs_.get());
+        finished_ = true;
+        if (file_ != nullptr)
+        {
+            bool ok = ::fclose(file_) == 0;
+            file_ = nullptr;
+            if (!ok)
+            {
+                throw std::runtime_error(file_name_ + ": write failed!");
+            }
+        }
+    }
+
+    void encode_png(const PNGSink &sink, const Color *pixels, int w, int h,
+                    int level, int threads, bool palette)
+    {
+        std::vector<unsigned char> stream;
+        std::vector<unsigned char> colors;
+        int depth = 8;
+        int color_type = 2;
+        std::vector<unsigned char> indexes;
+        if (palette && index_colors(pixels, (size_t)w * h, indexes, colors))
+        {
+            size_t n = colors.size() / 3;
+            depth = n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8;
+            color_type = 3;
+            std::vector<unsigned char> packed = pack_indexes(indexes, w, h, depth);
+            std::vector<unsigned char>().swap(indexes);
+            stream = deflate_blocks(packed, level, threads);
+        }
+        else
+        {
+            std::vector<unsigned char>().swap(indexes);
+            stream = deflate_blocks(filter_rgb(pixels, w, h, threads), level, threads);
+        }
+
+        write_header(sink, w, h, depth, color_type);
+        if (color_type == 3)
+        {
+            write_chunk(sink, "PLTE", colors.data(), colors.size());
+        }
+        const size_t CHUNK = 1 << 20;
+        for (size_t pos = 0; pos < stream.size(); pos += CHUNK)
+        {
+            write_chunk(sink, "IDAT", &stream[pos], std::min(CHUNK, stream.size() - pos));
+        }
+        write_chunk(sink, "IEND", nullptr, 0);
+    }
+
+    std::vector<unsigned char> encode_png(const Color *pixels, int w, int h,
+                                          int level, int threads, bool palette)
+    {
+        std::vector<unsigned char> png;
+        encode_png([&png](const unsigned char *data, size_t len)
+        {
+            png.insert(png.end(), data, data + len);
+        }, pixels, w, h, level, threads, palette);
+        return png;
+    }
+
+    void write_png(const std::string &png_file_name, const Color *pixels, int w, int h,
+                   int level, int threads, bool palette)
+    {
+        FILE *file = ::fopen(png_file_name.c_str(), "wb");
+        if (file == nullptr)
+        {
+            throw std::runtime_error(png_file_name + ": could not open for writing!");
+        }
+        try
+        {
+            encode_png(file_sink(file, png_file_name), pixels, w, h, level, threads, palette);
+        }
+        catch (...)
+        {
+            ::fclose(file);
+            throw;
+        }
+        if (::fclose(file) != 0)
+        {
+            throw std::runtime_error(png_file_name + ": write failed!");
+        }
+    }
+}
@@ -0,0 +1,114 @@
+//! @file PNGWriter.hpp
+#ifndef __svg_PNGWriter_hpp__
+#define __svg_PNGWriter_hpp__
+
+#include "Color.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct z_stream_s;
+
+namespace svg
+{
+    //! Receives the bytes of an encoded PNG, in order.
+    //! May throw to abort encoding.
+    typedef std::function<void(const unsigned char *data, size_t len)> PNGSink;
+
+    //! Incremental PNG encoder.
+    //! Rows are filtered and deflated as they are written, so only a
+    //! couple of rows (plus the compressor state) are kept in memory.
+    class PNGWriter
+    {
+    public:
+        //! Constructor that starts writing a file.
+        //! @param png_file_name Output file name.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param level zlib compression level, from 1 (fastest) to 9 (smallest).
+        PNGWriter(const std::string &png_file_name, int w, int h, int level = 6);
+        //! Constructor that starts writing to a sink.
+        //! @param sink Output.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param level zlib compression level, from 1 (fastest) to 9 (smallest).
+        PNGWriter(const PNGSink &sink, int w, int h, int level = 6);
+        //! Destructor.
+        ~PNGWriter();
+        PNGWriter(const PNGWriter &) = delete;
+        PNGWriter &operator=(const PNGWriter &) = delete;
+        //! Append rows to the image, top to bottom.
+        //! @param pixels Row-major pixels of the rows.
+        //! @param rows Number of rows.
+        void write_rows(const Color *pixels, int rows);
+        //! Write the remaining data and close the file (if any).
+        //! All rows must have been written.
+        void finish();
+
+    private:
+        //! Initialize the compressor and write the header.
+        //! @param level zlib compression level.
+        void start(int level);
+        //! Write a chunk.
+        //! @param type Chunk type (4 characters).
+        //! @param data Chunk data.
+        //! @param len Data length.
+        void write_chunk(const char *type, const unsigned char *data, size_t len);
+        //! Run the compressor and emit full IDAT chunks.
+        //! @param flush zlib flush mode.
+        void compress(int flush);
+
+        //! Output file name (for error messages).
+        std::string file_name_;
+        //! Output.
+        PNGSink sink_;
+        //! Output file (null when writing to a caller's sink).
+        FILE *file_;
+        //! Image width.
+        int width_;
+        //! Image height.
+        int height_;
+        //! Rows written so far.
+        int rows_written_;
+        //! Whether the compressor is released (finished or never started).
+        bool finished_;
+        //! Compressor state.
+        std::unique_ptr<z_stream_s> zs_;
+        //! Previous raw row (for filtering).
+        std::vector<unsigned char> prev_;
+        //! Candidate filtered rows, one per PNG filter type.
+        std::vector<unsigned char> filtered_;
+        //! Compressed data waiting to be written as an IDAT chunk.
+        std::vector<unsigned char> out_;
+    };
+
+    //! Encode a whole image as PNG.
+    //! Rows are filtered in parallel, and the image data is compressed in
+    //! independent blocks on several threads, each block starting with
+    //! the previous 32 KiB as its dictionary (like pigz).
+    //! @param sink Output.
+    //! @param pixels Row-major pixels.
+    //! @param w Image width.
+    //! @param h Image height.
+    //! @param level zlib compression level, from 1 (fastest) to 9 (smallest).
+    //! @param threads Number of threads.
+    //! @param palette Whether to write an indexed PNG (1, 2, 4 or 8 bits
+    //! per pixel) when the image has at most 256 colors; images with more
+    //! colors are written as truecolor.
+    void encode_png(const PNGSink &sink, const Color *pixels, int w, int h,
+                    int level, int threads, bool palette = false);
+    //! Encode a whole image as PNG in memory (see encode_png above).
+    //! @return The PNG file contents.
+    std::vector<unsigned char> encode_png(const Color *pixels, int w, int h,
+                                          int level, int threads, bool palette = false);
+
+    //! Encode a whole image as a PNG file (see encode_png above).
+    //! @param png_file_name Output file name.
+    void write_png(const std::string &png_file_name, const Color *pixels, int w, int h,
+                   int level, int threads, bool palette = false);
+}
+
+#endif
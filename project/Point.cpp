@@ -1,5 +1,6 @@
 //! @file point.cpp
 #include <cmath>
+#include <algorithm>
 #include "Point.hpp"
 
 namespace svg
@@ -27,4 +28,43 @@ namespace svg
                 origin.y + (y - origin.y) * v};
     }
 
+    bool BoundingBox::empty() const
+    {
+        return max.x < min.x || max.y < min.y;
+    }
+
+    bool BoundingBox::intersects(const BoundingBox &o) const
+    {
+        return !intersect(o).empty();
+    }
+
+    BoundingBox BoundingBox::intersect(const BoundingBox &o) const
+    {
+        return {{std::max(min.x, o.min.x), std::max(min.y, o.min.y)},
+                {std::min(max.x, o.max.x), std::min(max.y, o.max.y)}};
+    }
+
+    BoundingBox BoundingBox::unite(const BoundingBox &o) const
+    {
+        if (empty())
+        {
+            return o;
+        }
+        if (o.empty())
+        {
+            return *this;
+        }
+        return {{std::min(min.x, o.min.x), std::min(min.y, o.min.y)},
+                {std::max(max.x, o.max.x), std::max(max.y, o.max.y)}};
+    }
+
+    BoundingBox BoundingBox::of(const Point *points, size_t n)
+    {
+        BoundingBox box = {{0, 0}, {-1, -1}};
+        for (size_t i = 0; i < n; i++)
+        {
+            box = box.unite({points[i], points[i]});
+        }
+        return box;
+    }
 }
@@ -2,6 +2,8 @@
 #ifndef __svg_point_hpp__
 #define __svg_point_hpp__
 
+#include <cstddef>
+
 namespace svg
 {
     //! 2D Point struct, with a few convenience member functions (can be defined for structs too).
@@ -27,5 +29,36 @@ namespace svg
         //! @return Scaling result.
         Point scale(const Point &origin, int v) const;
     };
+
+    //! Axis-aligned box with inclusive pixel bounds.
+    //! A box is empty when max < min on either axis.
+    struct BoundingBox
+    {
+        //! Top-left corner.
+        Point min;
+        //! Bottom-right corner.
+        Point max;
+
+        //! Check if the box covers no pixels.
+        //! @return true if empty.
+        bool empty() const;
+        //! Check if two boxes share at least one pixel.
+        //! @param o Other box.
+        //! @return true if they intersect.
+        bool intersects(const BoundingBox &o) const;
+        //! Intersection of two boxes.
+        //! @param o Other box.
+        //! @return Intersection result (possibly empty).
+        BoundingBox intersect(const BoundingBox &o) const;
+        //! Smallest box containing both boxes.
+        //! @param o Other box.
+        //! @return Union result.
+        BoundingBox unite(const BoundingBox &o) const;
+        //! Bounding box of a sequence of points.
+        //! @param points Points.
+        //! @param n Number of points.
+        //! @return The box (empty if n is 0).
+        static BoundingBox of(const Point *points, size_t n);
+    };
 }
 #endif
@@ -0,0 +1,318 @@
+#include "RenderCache.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace svg
+{
+    namespace
+    {
+        const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+        const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+        //! Version of the images the renderer and PNG writer produce,
+        //! mixed into every key. Bump it when a change alters the output
+        //! for the same input and options, so older entries are not hit.
+        const int RENDER_VERSION = 1;
+
+        inline uint64_t rotl(uint64_t x, int r)
+        {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        //! Final mix, so every input bit affects every output bit.
+        inline uint64_t avalanche(uint64_t h)
+        {
+            h ^= h >> 33;
+            h *= PRIME2;
+            h ^= h >> 29;
+            h *= PRIME1;
+            h ^= h >> 32;
+            return h;
+        }
+
+        //! Read a whole file (through a mapping when possible) and hash it.
+        uint64_t hash_file(const std::string &file_name)
+        {
+            MappedFile mapped(file_name);
+            if (mapped.valid())
+            {
+                return RenderCache::hash(mapped.data(), mapped.size());
+            }
+            FILE *f = ::fopen(file_name.c_str(), "rb");
+            if (f == nullptr)
+            {
+                throw std::runtime_error("Unable to load " + file_name);
+            }
+            std::vector<char> data;
+            char buffer[1 << 16];
+            size_t n;
+            while ((n = ::fread(buffer, 1, sizeof(buffer), f)) > 0)
+            {
+                data.insert(data.end(), buffer, buffer + n);
+            }
+            bool failed = ::ferror(f) != 0;
+            ::fclose(f);
+            if (failed)
+            {
+                throw std::runtime_error("Unable to load " + file_name);
+            }
+            return RenderCache::hash(data.data(), data.size());
+        }
+
+        //! Copy a file.
+        void copy_file(const std::string &from, const std::string &to)
+        {
+            FILE *in = ::fopen(from.c_str(), "rb");
+            if (in == nullptr)
+            {
+                throw std::runtime_error("Unable to load " + from);
+            }
+            FILE *out = ::fopen(to.c_str(), "wb");
+            if (out == nullptr)
+            {
+                ::fclose(in);
+                throw std::runtime_error("Unable to write " + to);
+            }
+            char buffer[1 << 16];
+            size_t n;
+            bool ok = true;
+            while (ok && (n = ::fread(buffer, 1, sizeof(buffer), in)) > 0)
+            {
+                ok = ::fwrite(buffer, 1, n, out) == n;
+            }
+            ok = ok && ::ferror(in) == 0;
+            ::fclose(in);
+            ok = ::fclose(out) == 0 && ok;
+            if (!ok)
+            {
+                throw std::runtime_error("Unable to write " + to);
+            }
+        }
+
+        //! Copy a cache entry to the output. Outputs are never linked to
+        //! entries, since a later write to the output would change the
+        //! entry too. The old output is removed first: it may still be a
+        //! link made by an earlier version of the cache.
+        void place(const std::string &entry, const std::string &png_file)
+        {
+            ::unlink(png_file.c_str());
+            copy_file(entry, png_file);
+        }
+
+        //! Cache entry found in the directory.
+        struct FoundEntry
+        {
+            std::string name;
+            time_t used;
+            unsigned long long size;
+        };
+    }
+
+    RenderCache::RenderCache(const std::string &dir, unsigned long long max_bytes)
+        : dir_(dir), max_bytes_(max_bytes), clock_(0), total_bytes_(0), hits_(0), misses_(0), evictions_(0)
+    {
+        if (::mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        {
+            throw std::runtime_error("Unable to create cache directory " + dir);
+        }
+        // Index the existing entries, from the least recently used.
+        DIR *d = ::opendir(dir_.c_str());
+        if (d == nullptr)
+        {
+            return;
+        }
+        std::vector<FoundEntry> found;
+        while (struct dirent *e = ::readdir(d))
+        {
+            size_t len = ::strlen(e->d_name);
+            if (len < 4 || ::strcmp(e->d_name + len - 4, ".png") != 0)
+            {
+                continue;
+            }
+            struct stat st;
+            if (::stat((dir_ + "/" + e->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            {
+                found.push_back({e->d_name, st.st_mtime, (unsigned long long)st.st_size});
+            }
+        }
+        ::closedir(d);
+        std::sort(found.begin(), found.end(), [](const FoundEntry &a, const FoundEntry &b)
+        {
+            return a.used < b.used;
+        });
+        for (const FoundEntry &e : found)
+        {
+            touch(e.name, e.size);
+        }
+    }
+
+    uint64_t RenderCache::hash(const void *data, size_t size, uint64_t seed)
+    {
+        // Two independent lanes over 16-byte blocks, in the style of xxHash.
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        uint64_t h1 = seed + PRIME1, h2 = seed ^ PRIME2;
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            uint64_t w1, w2;
+            ::memcpy(&w1, p + i, 8);
+            ::memcpy(&w2, p + i + 8, 8);
+            h1 = rotl(h1 + w1 * PRIME2, 31) * PRIME1;
+            h2 = rotl(h2 + w2 * PRIME2, 31) * PRIME1;
+        }
+        uint64_t h = rotl(h1, 1) + rotl(h2, 7) + size * PRIME1;
+        for (; i < size; i++)
+        {
+            h = rotl(h ^ (p[i] * PRIME1), 11) * PRIME2;
+        }
+        return avalanche(h);
+    }
+
+    std::string RenderCache::key(const std::string &svg_file, const RenderOptions &options) const
+    {
+        // The renderer version and the options that change the output
+        // bytes; the other options (threads, streaming, mmap_input,
+        // front_to_back) only change how it is made.
+        int output_options[] = {RENDER_VERSION, options.antialias, options.compression, options.palette,
+                                options.band_rows > 0};
+        uint64_t h = hash(output_options, sizeof(output_options), hash_file(svg_file));
+        char name[17];
+        ::snprintf(name, sizeof(name), "%016llx", (unsigned long long)h);
+        return name;
+    }
+
+    RenderStats RenderCache::convert(const std::string &svg_file, const std::string &png_file,
+                                     const RenderOptions &options, bool *hit, Converter *converter)
+    {
+        std::string name = key(svg_file, options) + ".png";
+        std::string entry = dir_ + "/" + name;
+        struct stat st;
+        if (::stat(entry.c_str(), &st) == 0)
+        {
+            // Mark as recently used, for other processes too (entries may
+            // be evicted concurrently, in which case the image is rendered
+            // again below).
+            ::utime(entry.c_str(), nullptr);
+            try
+            {
+                place(entry, png_file);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    touch(name, st.st_size);
+                }
+                hits_++;
+                if (hit != nullptr)
+                {
+                    *hit = true;
+                }
+                return RenderStats();
+            }
+            catch (const std::runtime_error &)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                forget(name);
+            }
+        }
+        misses_++;
+        if (hit != nullptr)
+        {
+            *hit = false;
+        }
+        // Render into a temporary file that is renamed into place, so that
+        // other processes never see a partial entry.
+        static std::atomic<unsigned> counter(0);
+        std::string temp = entry + "." + std::to_string(::getpid()) + "." + std::to_string(counter++) + ".tmp";
+        RenderStats stats;
+        try
+        {
+            stats = converter != nullptr ? converter->convert(svg_file, temp, options)
+                                         : svg::convert(svg_file, temp, options);
+        }
+        catch (...)
+        {
+            ::unlink(temp.c_str());
+            throw;
+        }
+        if (::stat(temp.c_str(), &st) != 0 || ::rename(temp.c_str(), entry.c_str()) != 0)
+        {
+            ::unlink(temp.c_str());
+            throw std::runtime_error("Unable to write " + entry);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            touch(name, st.st_size);
+        }
+        place(entry, png_file);
+        evict();
+        return stats;
+    }
+
+    void RenderCache::touch(const std::string &name, unsigned long long size)
+    {
+        auto it = entries_.find(name);
+        if (it == entries_.end())
+        {
+            it = entries_.insert({name, Entry()}).first;
+        }
+        else
+        {
+            lru_.erase(it->second.used);
+            total_bytes_ -= it->second.size;
+        }
+        it->second.used = ++clock_;
+        it->second.size = size;
+        lru_[clock_] = name;
+        total_bytes_ += size;
+    }
+
+    void RenderCache::forget(const std::string &name)
+    {
+        auto it = entries_.find(name);
+        if (it != entries_.end())
+        {
+            lru_.erase(it->second.used);
+            total_bytes_ -= it->second.size;
+            entries_.erase(it);
+        }
+    }
+
+    void RenderCache::evict()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (total_bytes_ > max_bytes_ && !lru_.empty())
+        {
+            std::string name = lru_.begin()->second;
+            if (::unlink((dir_ + "/" + name).c_str()) == 0)
+            {
+                evictions_++;
+            }
+            forget(name);
+        }
+    }
+
+    unsigned long long RenderCache::hits() const
+    {
+        return hits_;
+    }
+
+    unsigned long long RenderCache::misses() const
+    {
+        return misses_;
+    }
+
+    unsigned long long RenderCache::evictions() const
+    {
+        return evictions_;
+    }
+}
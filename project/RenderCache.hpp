@@ -0,0 +1,106 @@
+//! @file RenderCache.hpp
+#ifndef __svg_RenderCache_hpp__
+#define __svg_RenderCache_hpp__
+
+#include "SVGElements.hpp"
+#include "Converter.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace svg
+{
+    //! On-disk cache of rendered images, keyed by a hash of the input
+    //! bytes, of the options that affect the output and of the renderer
+    //! version. A hit copies the cached PNG to the output, so converting
+    //! a repeated input costs one hash and one copy of its contents.
+    //! Entries are evicted least recently used first when the cache grows
+    //! past its size limit. Several processes may share a cache directory.
+    //!
+    //! The entries and their total size are indexed in memory: the
+    //! directory is scanned once, when the cache is created, and eviction
+    //! only looks at the index. Each process thus enforces the limit on
+    //! the entries it found or added; entries added by other processes
+    //! join the index when they are hit.
+    class RenderCache
+    {
+    public:
+        //! Constructor.
+        //! @param dir Cache directory (created if needed).
+        //! @param max_bytes Size limit of the cached images.
+        RenderCache(const std::string &dir, unsigned long long max_bytes = 256ULL << 20);
+        //! Convert an SVG file (or scene file) to a PNG file, using the
+        //! cache (see svg::convert).
+        //! @param svg_file Input file name.
+        //! @param png_file Output file name.
+        //! @param options Rendering options.
+        //! @param hit If not null, set to whether the image came from
+        //! the cache.
+        //! @param converter If not null, converter used on a miss.
+        //! @return Rendering statistics (all zero on a hit).
+        RenderStats convert(const std::string &svg_file, const std::string &png_file,
+                            const RenderOptions &options, bool *hit = nullptr,
+                            Converter *converter = nullptr);
+        //! Get the number of conversions served from the cache.
+        //! @return The number of hits.
+        unsigned long long hits() const;
+        //! Get the number of conversions that had to render.
+        //! @return The number of misses.
+        unsigned long long misses() const;
+        //! Get the number of entries evicted.
+        //! @return The number of evictions.
+        unsigned long long evictions() const;
+        //! Hash a byte sequence (64-bit, not cryptographic).
+        //! @param data Bytes.
+        //! @param size Number of bytes.
+        //! @param seed Initial value.
+        //! @return The hash.
+        static uint64_t hash(const void *data, size_t size, uint64_t seed = 0);
+
+    private:
+        //! Cache key of a conversion.
+        //! @return The key, as a file name stem.
+        std::string key(const std::string &svg_file, const RenderOptions &options) const;
+        //! Add an entry to the index, or mark it as the most recently used.
+        //! Call with mutex_ locked.
+        //! @param name Entry file name.
+        //! @param size Entry size.
+        void touch(const std::string &name, unsigned long long size);
+        //! Remove an entry from the index. Call with mutex_ locked.
+        //! @param name Entry file name.
+        void forget(const std::string &name);
+        //! Remove the least recently used entries while over the limit.
+        void evict();
+
+        //! Indexed entry.
+        struct Entry
+        {
+            //! Last use (order of use within this process).
+            unsigned long long used;
+            //! Size in bytes.
+            unsigned long long size;
+        };
+
+        //! Cache directory.
+        std::string dir_;
+        //! Size limit.
+        unsigned long long max_bytes_;
+        //! Guards the index.
+        std::mutex mutex_;
+        //! Entries, by file name.
+        std::map<std::string, Entry> entries_;
+        //! File names of the entries, by last use.
+        std::map<unsigned long long, std::string> lru_;
+        //! Last use given out.
+        unsigned long long clock_;
+        //! Total size of the entries.
+        unsigned long long total_bytes_;
+        //! Counters.
+        std::atomic<unsigned long long> hits_, misses_, evictions_;
+    };
+}
+
+#endif
@@ -0,0 +1,486 @@
+#include "RenderServer.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace svg
+{
+    namespace
+    {
+        //! Size of a request header (size, flags, compression, band rows).
+        const size_t REQUEST_HEADER = 16;
+        //! Size of a response header (size, status, server time).
+        const size_t RESPONSE_HEADER = 12;
+
+        enum Flags
+        {
+            ANTIALIAS = 1,
+            FRONT_TO_BACK = 2,
+            PALETTE = 4,
+            STREAMING = 8
+        };
+
+        void put_u32(unsigned char *p, uint32_t v)
+        {
+            p[0] = (unsigned char)(v >> 24);
+            p[1] = (unsigned char)(v >> 16);
+            p[2] = (unsigned char)(v >> 8);
+            p[3] = (unsigned char)v;
+        }
+
+        uint32_t get_u32(const unsigned char *p)
+        {
+            return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+
+        typedef std::chrono::steady_clock Clock;
+
+        //! Wait until a connection is ready for reading or writing.
+        //! @param events POLLIN or POLLOUT.
+        //! @param deadline If not null, time after which to give up.
+        //! @return false if the deadline passed or on error.
+        bool wait_ready(int fd, short events, const Clock::time_point *deadline)
+        {
+            int timeout = -1;
+            if (deadline != nullptr)
+            {
+                long long micros = std::chrono::duration_cast<std::chrono::microseconds>(*deadline - Clock::now()).count();
+                if (micros <= 0)
+                {
+                    return false;
+                }
+                timeout = (int)((micros + 999) / 1000);
+            }
+            pollfd p = {fd, events, 0};
+            int n = ::poll(&p, 1, timeout);
+            // An interrupted wait is retried by the caller.
+            return n > 0 || (n < 0 && errno == EINTR);
+        }
+
+        //! Read exactly size bytes.
+        //! @param deadline If not null, time by which all must be read.
+        //! @return false on end of input, error or timeout.
+        bool read_all(int fd, void *data, size_t size, const Clock::time_point *deadline = nullptr)
+        {
+            char *p = (char *)data;
+            while (size > 0)
+            {
+                if (!wait_ready(fd, POLLIN, deadline))
+                {
+                    return false;
+                }
+                ssize_t n = ::recv(fd, p, size, MSG_DONTWAIT);
+                if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        //! Write exactly size bytes (without raising SIGPIPE).
+        //! @param deadline If not null, time by which all must be written.
+        //! @return false on error or timeout.
+        bool write_all(int fd, const void *data, size_t size, const Clock::time_point *deadline = nullptr)
+        {
+            const char *p = (const char *)data;
+            while (size > 0)
+            {
+                if (!wait_ready(fd, POLLOUT, deadline))
+                {
+                    return false;
+                }
+                ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    return false;
+                }
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        //! Fill in the address of a socket file.
+        sockaddr_un socket_address(const std::string &socket_path)
+        {
+            sockaddr_un address;
+            ::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (socket_path.size() >= sizeof(address.sun_path))
+            {
+                throw std::runtime_error("Socket path too long: " + socket_path);
+            }
+            ::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+            return address;
+        }
+    }
+
+    const int RenderServer::IO_TIMEOUT;
+
+    RenderServer::RenderServer(const std::string &socket_path, int workers, size_t queue_size,
+                               const RenderOptions &options)
+        : socket_path_(socket_path), workers_(workers > 0 ? workers : 1), queue_size_(queue_size > 0 ? queue_size : 1),
+          options_(options), listener_(-1), stopping_(false), closed_(false), connections_(0), requests_(0),
+          failures_(0), busy_micros_(0)
+    {
+        sockaddr_un address = socket_address(socket_path);
+        if (::pipe(wakeup_) != 0)
+        {
+            throw std::runtime_error(std::string("Unable to create pipe: ") + ::strerror(errno));
+        }
+        // Wake-ups are never lost, however many are pending: a full pipe
+        // already makes run() return from poll().
+        ::fcntl(wakeup_[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(wakeup_[1], F_SETFL, O_NONBLOCK);
+        listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        struct stat st;
+        if (::lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            ::unlink(socket_path.c_str());
+        }
+        if (listener_ < 0 || ::bind(listener_, (const sockaddr *)&address, sizeof(address)) != 0 ||
+            ::listen(listener_, (int)queue_size_) != 0)
+        {
+            std::string error = ::strerror(errno);
+            if (listener_ >= 0)
+            {
+                ::close(listener_);
+            }
+            ::close(wakeup_[0]);
+            ::close(wakeup_[1]);
+            throw std::runtime_error("Unable to listen on " + socket_path + ": " + error);
+        }
+    }
+
+    RenderServer::~RenderServer()
+    {
+        ::close(listener_);
+        ::close(wakeup_[0]);
+        ::close(wakeup_[1]);
+        ::unlink(socket_path_.c_str());
+    }
+
+    //! Buffers and converter of a worker thread, reused between requests.
+    struct RenderServer::Worker
+    {
+        Converter converter;
+        std::vector<char> request;
+        std::vector<unsigned char> response;
+    };
+
+    void RenderServer::run()
+    {
+        std::vector<std::thread> pool;
+        for (int i = 0; i < workers_; i++)
+        {
+            pool.emplace_back(&RenderServer::work, this);
+        }
+        // Connections waiting for their next request.
+        std::vector<int> idle;
+        std::vector<pollfd> fds;
+        while (!stopping_)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                idle.insert(idle.end(), returned_.begin(), returned_.end());
+                returned_.clear();
+                // Back-pressure: accept nothing and read no request while
+                // every queue slot is taken.
+                if (queue_.size() >= queue_size_)
+                {
+                    not_full_.wait_for(lock, std::chrono::milliseconds(100));
+                    continue;
+                }
+            }
+            fds.assign({{wakeup_[0], POLLIN, 0}, {listener_, POLLIN, 0}});
+            for (int fd : idle)
+            {
+                fds.push_back({fd, POLLIN, 0});
+            }
+            if (::poll(fds.data(), fds.size(), -1) < 0)
+            {
+                continue;
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                char drain[64];
+                while (::read(wakeup_[0], drain, sizeof(drain)) > 0)
+                {
+                }
+            }
+            {
+                // Queue the connections with a request (or an end of
+                // input, which the worker sees), as long as there is room.
+                std::lock_guard<std::mutex> lock(mutex_);
+                size_t kept = 0;
+                for (size_t i = 0; i < idle.size(); i++)
+                {
+                    if (fds[i + 2].revents != 0 && queue_.size() < queue_size_)
+                    {
+                        queue_.push_back(idle[i]);
+                        not_empty_.notify_one();
+                    }
+                    else
+                    {
+                        idle[kept++] = idle[i];
+                    }
+                }
+                idle.resize(kept);
+            }
+            if (fds[1].revents & POLLIN)
+            {
+                int fd = ::accept(listener_, nullptr, nullptr);
+                if (fd >= 0)
+                {
+                    connections_++;
+                    idle.push_back(fd);
+                }
+            }
+        }
+
+        {
+            // Let the requests being answered finish, and drop the others.
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            for (int fd : active_)
+            {
+                ::shutdown(fd, SHUT_RD);
+            }
+            for (int fd : queue_)
+            {
+                ::close(fd);
+            }
+            queue_.clear();
+            not_empty_.notify_all();
+        }
+        for (std::thread &th : pool)
+        {
+            th.join();
+        }
+        idle.insert(idle.end(), returned_.begin(), returned_.end());
+        returned_.clear();
+        for (int fd : idle)
+        {
+            ::close(fd);
+        }
+    }
+
+    void RenderServer::wake()
+    {
+        char c = 0;
+        if (::write(wakeup_[1], &c, 1) < 0)
+        {
+            // The pipe is full: run() is woken up already.
+        }
+    }
+
+    void RenderServer::stop()
+    {
+        stopping_ = true;
+        wake();
+    }
+
+    void RenderServer::work()
+    {
+        Worker worker;
+        for (;;)
+        {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                not_empty_.wait(lock, [this]
+                                { return closed_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+                fd = queue_.front();
+                queue_.pop_front();
+                active_.insert(fd);
+                not_full_.notify_one();
+            }
+            bool keep = serve(fd, worker);
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_.erase(fd);
+            if (keep && !closed_)
+            {
+                returned_.push_back(fd);
+                wake();
+            }
+            else
+            {
+                ::close(fd);
+            }
+        }
+    }
+
+    bool RenderServer::serve(int fd, Worker &worker)
+    {
+        std::vector<char> &request = worker.request;
+        std::vector<unsigned char> &response = worker.response;
+        // The whole request must arrive, and later the whole response
+        // leave, within IO_TIMEOUT, however the client spreads its bytes.
+        Clock::time_point deadline = Clock::now() + std::chrono::seconds(IO_TIMEOUT);
+        unsigned char header[REQUEST_HEADER];
+        if (!read_all(fd, header, sizeof(header), &deadline))
+        {
+            return false;
+        }
+        uint32_t size = get_u32(header), flags = get_u32(header + 4);
+        uint32_t status = 0;
+        bool too_large = size > MAX_REQUEST;
+        response.assign(RESPONSE_HEADER, 0);
+        if (too_large)
+        {
+            // The document is not read, so the connection cannot go on.
+            static const char message[] = "Request too large";
+            response.insert(response.end(), message, message + sizeof(message) - 1);
+            status = 1;
+        }
+        else
+        {
+            request.resize(size);
+            if (!read_all(fd, request.data(), size, &deadline))
+            {
+                return false;
+            }
+        }
+        Clock::time_point start = Clock::now();
+        if (status == 0)
+        {
+            RenderOptions options = options_;
+            options.antialias = (flags & ANTIALIAS) != 0;
+            options.front_to_back = (flags & FRONT_TO_BACK) != 0;
+            options.palette = (flags & PALETTE) != 0;
+            options.streaming = (flags & STREAMING) != 0;
+            options.compression = (int)get_u32(header + 8);
+            options.band_rows = (int)get_u32(header + 12);
+            options.max_pixels = MAX_PIXELS;
+            try
+            {
+                if (options.compression < 1 || options.compression > 9)
+                {
+                    throw std::runtime_error("Invalid compression level " + std::to_string(options.compression));
+                }
+                if (options.band_rows < 0)
+                {
+                    throw std::runtime_error("Invalid band rows " + std::to_string(options.band_rows));
+                }
+                worker.converter.convert_buffer(request.data(), size, [&response](const unsigned char *data, size_t len)
+                                                { response.insert(response.end(), data, data + len); },
+                                                options);
+            }
+            catch (const std::exception &e)
+            {
+                response.resize(RESPONSE_HEADER);
+                response.insert(response.end(), e.what(), e.what() + ::strlen(e.what()));
+                status = 1;
+            }
+        }
+        uint32_t micros = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+        put_u32(response.data(), (uint32_t)(response.size() - RESPONSE_HEADER));
+        put_u32(response.data() + 4, status);
+        put_u32(response.data() + 8, micros);
+        requests_++;
+        failures_ += status != 0;
+        busy_micros_ += micros;
+        deadline = Clock::now() + std::chrono::seconds(IO_TIMEOUT);
+        return write_all(fd, response.data(), response.size(), &deadline) && !too_large;
+    }
+
+    unsigned long long RenderServer::connections() const
+    {
+        return connections_;
+    }
+
+    unsigned long long RenderServer::requests() const
+    {
+        return requests_;
+    }
+
+    unsigned long long RenderServer::failures() const
+    {
+        return failures_;
+    }
+
+    unsigned long long RenderServer::busy_micros() const
+    {
+        return busy_micros_;
+    }
+
+    RenderClient::RenderClient(const std::string &socket_path)
+        : fd_(::socket(AF_UNIX, SOCK_STREAM, 0))
+    {
+        sockaddr_un address = socket_address(socket_path);
+        if (fd_ < 0 || ::connect(fd_, (const sockaddr *)&address, sizeof(address)) != 0)
+        {
+            std::string error = ::strerror(errno);
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+            }
+            throw std::runtime_error("Unable to connect to " + socket_path + ": " + error);
+        }
+    }
+
+    RenderClient::~RenderClient()
+    {
+        ::close(fd_);
+    }
+
+    std::vector<unsigned char> RenderClient::convert(const char *svg_data, size_t size, const RenderOptions &options,
+                                                     unsigned *server_micros)
+    {
+        if (size > RenderServer::MAX_REQUEST)
+        {
+            throw std::runtime_error("Request too large");
+        }
+        unsigned char header[REQUEST_HEADER];
+        put_u32(header, (uint32_t)size);
+        put_u32(header + 4, (options.antialias ? ANTIALIAS : 0) | (options.front_to_back ? FRONT_TO_BACK : 0) |
+                                (options.palette ? PALETTE : 0) | (options.streaming ? STREAMING : 0));
+        put_u32(header + 8, (uint32_t)options.compression);
+        put_u32(header + 12, (uint32_t)options.band_rows);
+        unsigned char reply[RESPONSE_HEADER];
+        if (!write_all(fd_, header, sizeof(header)) || !write_all(fd_, svg_data, size) ||
+            !read_all(fd_, reply, sizeof(reply)))
+        {
+            throw std::runtime_error("Connection to the render server lost");
+        }
+        std::vector<unsigned char> payload(get_u32(reply));
+        if (!read_all(fd_, payload.data(), payload.size()))
+        {
+            throw std::runtime_error("Connection to the render server lost");
+        }
+        if (server_micros != nullptr)
+        {
+            *server_micros = get_u32(reply + 8);
+        }
+        if (get_u32(reply + 4) != 0)
+        {
+            throw std::runtime_error(std::string(payload.begin(), payload.end()));
+        }
+        return payload;
+    }
+}
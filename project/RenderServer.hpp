@@ -0,0 +1,157 @@
+//! @file RenderServer.hpp
+#ifndef __svg_RenderServer_hpp__
+#define __svg_RenderServer_hpp__
+
+#include "Converter.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Server converting SVG documents to PNG for clients connecting to a
+    //! local (Unix domain) socket.
+    //!
+    //! A connection carries any number of requests, answered in order.
+    //! All integers are 32-bit unsigned, in network byte order.
+    //! - Request: document size, option flags (1: antialias, 2: front to
+    //!   back, 4: palette, 8: streaming parser), compression level, band
+    //!   rows, then the SVG document.
+    //! - Response: payload size, status (0: success, 1: error), server
+    //!   time in microseconds, then the PNG file (or the error message).
+    //! Documents that cannot be rendered, including those larger than
+    //! MAX_REQUEST bytes or MAX_PIXELS pixels, and requests with a
+    //! compression level outside 1-9 or negative band rows get an error
+    //! response.
+    //!
+    //! Requests are answered by a fixed pool of workers, each keeping a
+    //! Converter warm between requests. Idle connections are watched by
+    //! run(); when a request arrives on one, the connection is queued for
+    //! the workers, which answer that request and hand the connection
+    //! back, so idle clients never hold a worker. The queue is bounded:
+    //! while it is full, the server neither accepts connections nor
+    //! reads requests, so clients wait in the socket's listen backlog and
+    //! in their writes. A client that takes more than IO_TIMEOUT seconds
+    //! to send a request once it started it, or to read its response, is
+    //! disconnected.
+    class RenderServer
+    {
+    public:
+        //! Largest SVG document accepted in a request.
+        static const uint32_t MAX_REQUEST = 64 << 20;
+        //! Largest canvas (in pixels) rendered for a request.
+        static const unsigned long long MAX_PIXELS = 1ULL << 26;
+        //! Longest time a client may take to send a request or to read a
+        //! response, in seconds.
+        static const int IO_TIMEOUT = 10;
+
+        //! Constructor. Creates the socket (replacing a stale socket file).
+        //! Throws std::runtime_error if the socket cannot be created.
+        //! @param socket_path Socket file name.
+        //! @param workers Number of worker threads.
+        //! @param queue_size Number of requests that may wait for a worker.
+        //! @param options Rendering options whose fields are not given by
+        //! requests (threads).
+        RenderServer(const std::string &socket_path, int workers, size_t queue_size, const RenderOptions &options);
+        //! Destructor. Removes the socket file.
+        ~RenderServer();
+        RenderServer(const RenderServer &) = delete;
+        RenderServer &operator=(const RenderServer &) = delete;
+        //! Serve clients until stop() is called. Requests being answered
+        //! are finished, then all connections are closed.
+        void run();
+        //! Make run() return. Can be called from any thread, but not from
+        //! a signal handler.
+        void stop();
+        //! Get the number of connections accepted.
+        //! @return Connections.
+        unsigned long long connections() const;
+        //! Get the number of requests answered.
+        //! @return Requests (including failed ones).
+        unsigned long long requests() const;
+        //! Get the number of requests that failed.
+        //! @return Failed requests.
+        unsigned long long failures() const;
+        //! Get the total server time of the requests answered.
+        //! @return Time in microseconds.
+        unsigned long long busy_micros() const;
+
+    private:
+        struct Worker;
+        //! Worker thread: answer the requests taken from the queue.
+        void work();
+        //! Answer one request of a connection.
+        //! @param fd Connection.
+        //! @param worker State of the worker.
+        //! @return Whether the connection can carry further requests.
+        bool serve(int fd, Worker &worker);
+        //! Wake up run() from another thread.
+        void wake();
+
+        //! Socket file name.
+        std::string socket_path_;
+        //! Number of worker threads.
+        int workers_;
+        //! Capacity of the request queue.
+        size_t queue_size_;
+        //! Rendering options not given by requests.
+        RenderOptions options_;
+        //! Listening socket.
+        int listener_;
+        //! Non-blocking pipe written to wake up run().
+        int wakeup_[2];
+        //! Whether stop() was called.
+        std::atomic<bool> stopping_;
+        //! Guards queue_, returned_, active_ and closed_.
+        std::mutex mutex_;
+        //! Signalled when a request is queued or the server closes.
+        std::condition_variable not_empty_;
+        //! Signalled when a request leaves the queue.
+        std::condition_variable not_full_;
+        //! Connections with a request waiting for a worker.
+        std::deque<int> queue_;
+        //! Connections handed back by the workers, to be watched again.
+        std::vector<int> returned_;
+        //! Connections whose request is being answered.
+        std::set<int> active_;
+        //! Whether workers should exit once the queue is empty.
+        bool closed_;
+        //! Statistics.
+        std::atomic<unsigned long long> connections_, requests_, failures_, busy_micros_;
+    };
+
+    //! Client of a RenderServer, holding one connection.
+    class RenderClient
+    {
+    public:
+        //! Constructor. Connects to the server.
+        //! Throws std::runtime_error if the connection fails.
+        //! @param socket_path Socket file name of the server.
+        RenderClient(const std::string &socket_path);
+        //! Destructor. Closes the connection.
+        ~RenderClient();
+        RenderClient(const RenderClient &) = delete;
+        RenderClient &operator=(const RenderClient &) = delete;
+        //! Convert an SVG document to PNG on the server.
+        //! Throws std::runtime_error if the server reports an error or the
+        //! connection fails.
+        //! @param svg_data Document contents.
+        //! @param size Size of the contents.
+        //! @param options Rendering options (threads is not sent).
+        //! @param server_micros If not null, receives the server time.
+        //! @return The PNG file contents.
+        std::vector<unsigned char> convert(const char *svg_data, size_t size, const RenderOptions &options,
+                                           unsigned *server_micros = nullptr);
+
+    private:
+        //! Connection.
+        int fd_;
+    };
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "SVGElements.hpp"
 #include "Point.hpp"
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 
 // Helper function to create Point
@@ -17,162 +18,185 @@ namespace svg
     SVGElement::SVGElement() {}
     SVGElement::~SVGElement() {}
 
+    void SVGElement::draw(PNGImage &img) const {
+        draw(img, Transform());
+    }
+
+    BoundingBox SVGElement::bounds() const {
+        return bounds(Transform());
+    }
+
+    void SVGElement::translate(const Point &offset) {
+        transform = Transform::translation(offset) * transform;
+    }
+
+    void SVGElement::rotate(int angle, const Point &origin) {
+        transform = Transform::rotation(angle, origin) * transform;
+    }
+
+    void SVGElement::scale(int factor, const Point &origin) {
+        transform = Transform::scaling(factor, origin) * transform;
+    }
+
+    // Map the points of a shape to the image, in one pass over the array
+    static std::vector<Point> map_points(const Transform &t, const Point *points, size_t n) {
+        std::vector<Point> mapped(n);
+        t.apply(points, mapped.data(), n);
+        return mapped;
+    }
+
+    // Radius of an ellipse under a transformation (ellipses stay axis-aligned)
+    static Point map_radius(const Transform &t, const Point &radius) {
+        double factor = t.scale_factor();
+        return create_point((int)std::lround(radius.x * factor), (int)std::lround(radius.y * factor));
+    }
+
+    static BoundingBox ellipse_bounds(const Point &center, const Point &radius) {
+        Point r = create_point(std::abs(radius.x), std::abs(radius.y));
+        return {center.translate({-r.x, -r.y}), center.translate(r)};
+    }
+
     // Ellipse
     Ellipse::Ellipse(const Color &fill, const Point &center, const Point &radius)
         : fill(fill), center(center), radius(radius) {}
 
-    void Ellipse::draw(PNGImage &img) const {
-        img.draw_ellipse(center, radius, fill);
-    }
-
-    void Ellipse::translate(const Point &offset) {
-        center = center.translate(offset);
+    void Ellipse::draw(PNGImage &img, const Transform &parent) const {
+        Transform t = parent * transform;
+        img.draw_ellipse(t.apply(center), map_radius(t, radius), fill);
     }
 
-    void Ellipse::rotate(int angle, const Point &origin) {
-        center = center.rotate(origin, angle);
+    BoundingBox Ellipse::bounds(const Transform &parent) const {
+        Transform t = parent * transform;
+        return ellipse_bounds(t.apply(center), map_radius(t, radius));
     }
 
-    void Ellipse::scale(int factor, const Point &origin) {
-        center = center.scale(origin, factor);
-        radius.x *= factor;
-        radius.y *= factor;
+    void Ellipse::compile(DisplayList &list, const Transform &parent) const {
+        Transform t = parent * transform;
+        list.add_ellipse(fill, t.apply(center), map_radius(t, radius));
     }
 
     // Circle
     Circle::Circle(const Color &fill, const Point &center, int radius)
         : fill(fill), center(center), radius(radius) {}
 
-    void Circle::draw(PNGImage &img) const {
-        img.draw_ellipse(center, create_point(radius, radius), fill);
-    }
-
-    void Circle::translate(const Point &offset) {
-        center = center.translate(offset);
+    void Circle::draw(PNGImage &img, const Transform &parent) const {
+        Transform t = parent * transform;
+        img.draw_ellipse(t.apply(center), map_radius(t, create_point(radius, radius)), fill);
     }
 
-    void Circle::rotate(int angle, const Point &origin) {
-        center = center.rotate(origin, angle);
+    BoundingBox Circle::bounds(const Transform &parent) const {
+        Transform t = parent * transform;
+        return ellipse_bounds(t.apply(center), map_radius(t, create_point(radius, radius)));
     }
 
-    void Circle::scale(int factor, const Point &origin) {
-        center = center.scale(origin, factor);
-        radius *= factor;
+    void Circle::compile(DisplayList &list, const Transform &parent) const {
+        Transform t = parent * transform;
+        list.add_ellipse(fill, t.apply(center), map_radius(t, create_point(radius, radius)));
     }
 
     // Rect
     Rect::Rect(const Color &fill, const Point &corner1, const Point &corner2, const Point &corner3, const Point &corner4) :
         fill(fill), corner1(corner1), corner2(corner2), corner3(corner3), corner4(corner4)  {}
 
-    void Rect::draw(PNGImage &img) const {
-        img.draw_polygon({
-            corner1,
-            corner2,
-            corner3,
-            corner4
-        }, fill);
+    void Rect::draw(PNGImage &img, const Transform &parent) const {
+        Point corners[] = {corner1, corner2, corner3, corner4};
+        img.draw_polygon(map_points(parent * transform, corners, 4), fill);
     }
 
-    void Rect::translate(const Point &offset) {
-        corner1 = corner1.translate(offset);
-        corner2 = corner2.translate(offset);
-        corner3 = corner3.translate(offset);
-        corner4 = corner4.translate(offset);
+    BoundingBox Rect::bounds(const Transform &parent) const {
+        Point corners[] = {corner1, corner2, corner3, corner4};
+        (parent * transform).apply(corners, corners, 4);
+        return BoundingBox::of(corners, 4);
     }
 
-    void Rect::rotate(int angle, const Point &origin) {
-        corner1 = corner1.rotate(origin, angle);
-        corner2 = corner2.rotate(origin, angle);
-        corner3 = corner3.rotate(origin, angle);
-        corner4 = corner4.rotate(origin, angle);
-    }
-
-    void Rect::scale(int factor, const Point &origin) {
-        corner1 = corner1.scale(origin, factor);
-        corner2 = corner2.scale(origin, factor);
-        corner3 = corner3.scale(origin, factor);
-        corner4 = corner4.scale(origin, factor);
+    void Rect::compile(DisplayList &list, const Transform &parent) const {
+        Point corners[] = {corner1, corner2, corner3, corner4};
+        list.add_polygon(fill, corners, 4, parent * transform);
     }
 
     // Line
     Line::Line(const Color &stroke, const Point &start, const Point &end)
         : stroke(stroke), start(start), end(end) {}
 
-    void Line::draw(PNGImage &img) const {
-        img.draw_line(start, end, stroke);
+    void Line::draw(PNGImage &img, const Transform &parent) const {
+        Transform t = parent * transform;
+        img.draw_line(t.apply(start), t.apply(end), stroke);
     }
 
-    void Line::translate(const Point &offset) {
-        start = start.translate(offset);
-        end = end.translate(offset);
+    BoundingBox Line::bounds(const Transform &parent) const {
+        Point ends[] = {start, end};
+        (parent * transform).apply(ends, ends, 2);
+        return BoundingBox::of(ends, 2);
     }
 
-    void Line::rotate(int angle, const Point &origin) {
-        start = start.rotate(origin, angle);
-        end = end.rotate(origin, angle);
-    }
-
-    void Line::scale(int factor, const Point &origin) {
-        start = start.scale(origin, factor);
-        end = end.scale(origin, factor);
+    void Line::compile(DisplayList &list, const Transform &parent) const {
+        Transform t = parent * transform;
+        list.add_line(stroke, t.apply(start), t.apply(end));
     }
 
     // Polyline
     Polyline::Polyline(const Color &stroke, const std::vector<Point> &points)
-        : stroke(stroke), points(points) {}
+        : stroke(stroke), points(points.begin(), points.end()) {}
 
-    void Polyline::draw(PNGImage &img) const {
-        for (size_t i = 0; i < points.size() - 1; i++) {
-            img.draw_line(points[i], points[i + 1], stroke);
-        }
-    }
+    Polyline::Polyline(const Color &stroke, PointList &&points)
+        : stroke(stroke), points(std::move(points)) {}
 
-    void Polyline::translate(const Point &offset) {
-        for (Point &point : points) {
-            point = point.translate(offset);
+    void Polyline::draw(PNGImage &img, const Transform &parent) const {
+        Transform t = parent * transform;
+        std::vector<Point> mapped;
+        if (!t.identity()) {
+            mapped = map_points(t, points.data(), points.size());
+        }
+        const Point *p = t.identity() ? points.data() : mapped.data();
+        for (size_t i = 1; i < points.size(); i++) {
+            img.draw_line(p[i - 1], p[i], stroke);
         }
     }
 
-    void Polyline::rotate(int angle, const Point &origin) {
-        for (Point &point : points) {
-            point = point.rotate(origin, angle);
+    BoundingBox Polyline::bounds(const Transform &parent) const {
+        Transform t = parent * transform;
+        if (t.identity()) {
+            return BoundingBox::of(points.data(), points.size());
         }
+        std::vector<Point> mapped = map_points(t, points.data(), points.size());
+        return BoundingBox::of(mapped.data(), mapped.size());
     }
 
-    void Polyline::scale(int factor, const Point &origin) {
-        for (Point &point : points) {
-            point = point.scale(origin, factor);
-        }
+    void Polyline::compile(DisplayList &list, const Transform &parent) const {
+        list.add_polyline(stroke, points.data(), points.size(), parent * transform);
     }
 
     // Polygon
     Polygon::Polygon(const Color &fill, const std::vector<Point> &points)
-        : fill(fill), points(points) {}
+        : fill(fill), points(points.begin(), points.end()) {}
 
-    void Polygon::draw(PNGImage &img) const {
-        img.draw_polygon(points, fill);
-    }
+    Polygon::Polygon(const Color &fill, PointList &&points)
+        : fill(fill), points(std::move(points)) {}
 
-    void Polygon::translate(const Point &offset) {
-        for (Point &point : points) {
-            point = point.translate(offset);
+    void Polygon::draw(PNGImage &img, const Transform &parent) const {
+        Transform t = parent * transform;
+        if (t.identity()) {
+            img.draw_polygon(points.data(), points.size(), fill);
+            return;
         }
+        img.draw_polygon(map_points(t, points.data(), points.size()), fill);
     }
 
-    void Polygon::rotate(int angle, const Point &origin) {
-        for (Point &point : points) {
-            point = point.rotate(origin, angle);
+    BoundingBox Polygon::bounds(const Transform &parent) const {
+        Transform t = parent * transform;
+        if (t.identity()) {
+            return BoundingBox::of(points.data(), points.size());
         }
+        std::vector<Point> mapped = map_points(t, points.data(), points.size());
+        return BoundingBox::of(mapped.data(), mapped.size());
     }
 
-    void Polygon::scale(int factor, const Point &origin) {
-        for (Point &point : points) {
-            point = point.scale(origin, factor);
-        }
+    void Polygon::compile(DisplayList &list, const Transform &parent) const {
+        list.add_polygon(fill, points.data(), points.size(), parent * transform);
     }
 
     // Group
-    Group::Group() {}
+    Group::Group(Arena *arena) : elements(ArenaAllocator<SVGElement*>(arena)) {}
     Group::~Group() {
         for (SVGElement* element : elements) {
             delete element;
@@ -183,28 +207,52 @@ namespace svg
         elements.push_back(element);
     }
 
-    void Group::draw(PNGImage &img) const {
+    void Group::draw(PNGImage &img, const Transform &parent) const {
+        Transform t = parent * transform;
+        if (img.front_to_back()) {
+            for (auto it = elements.rbegin(); it != elements.rend(); ++it) {
+                (*it)->draw(img, t);
+            }
+            return;
+        }
         for (SVGElement* element : elements) {
-            element->draw(img);
+            element->draw(img, t);
         }
     }
 
-    void Group::translate(const Point &offset) {
+    BoundingBox Group::bounds(const Transform &parent) const {
+        Transform t = parent * transform;
+        BoundingBox box = {{0, 0}, {-1, -1}};
         for (SVGElement* element : elements) {
-            element->translate(offset);
+            box = box.unite(element->bounds(t));
         }
+        return box;
     }
 
-    void Group::rotate(int angle, const Point &origin) {
+    void Group::compile(DisplayList &list, const Transform &parent) const {
+        Transform t = parent * transform;
         for (SVGElement* element : elements) {
-            element->rotate(angle, origin);
+            element->compile(list, t);
         }
     }
 
-    void Group::scale(int factor, const Point &origin) {
-        for (SVGElement* element : elements) {
-            element->scale(factor, origin);
-        }
+    // Instance
+    Instance::Instance(const std::shared_ptr<const SVGElement> &geometry)
+        : geometry(geometry) {}
+
+    const std::shared_ptr<const SVGElement> &Instance::shared_geometry() const {
+        return geometry;
+    }
+
+    void Instance::draw(PNGImage &img, const Transform &parent) const {
+        geometry->draw(img, parent * transform);
+    }
+
+    BoundingBox Instance::bounds(const Transform &parent) const {
+        return geometry->bounds(parent * transform);
+    }
 
+    void Instance::compile(DisplayList &list, const Transform &parent) const {
+        geometry->compile(list, parent * transform);
     }
 }
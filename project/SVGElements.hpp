@@ -5,8 +5,12 @@
 #include "Color.hpp"
 #include "Point.hpp"
 #include "PNGImage.hpp"
+#include "Transform.hpp"
+#include "DisplayList.hpp"
+#include "Arena.hpp"
 #include <vector>
 #include <string>
+#include <memory>
 
 namespace svg
 {
@@ -16,26 +20,116 @@ namespace svg
         SVGElement();
         virtual ~SVGElement();
 
-        virtual void draw(PNGImage &img) const = 0;
+        void draw(PNGImage &img) const;
+        //! Draw the element with a transformation applied after its own.
+        //! @param img Image to draw into.
+        //! @param parent Transformation of the enclosing elements.
+        virtual void draw(PNGImage &img, const Transform &parent) const = 0;
+        //! Get the box covering every pixel the element may draw.
+        //! @return The bounding box.
+        BoundingBox bounds() const;
+        //! Get the bounding box with a transformation applied after the
+        //! element's own.
+        //! @param parent Transformation of the enclosing elements.
+        //! @return The bounding box.
+        virtual BoundingBox bounds(const Transform &parent) const = 0;
+        //! Append the element's drawing commands to a display list.
+        //! @param list Display list.
+        //! @param parent Transformation of the enclosing elements.
+        virtual void compile(DisplayList &list, const Transform &parent) const = 0;
+
+        // other transformations (composed into the element's
+        // transformation, which is applied to its points when drawn)
+        void translate(const Point &offset);
+        void rotate(int angle, const Point &origin);
+        void scale(int factor, const Point &origin);
+
+    protected:
+        //! Transformation of the element.
+        Transform transform;
+    };
+
+    //! Options controlling how a document is rendered.
+    struct RenderOptions
+    {
+        //! Number of rendering threads (1 renders serially).
+        int threads = 1;
+        //! Whether to draw with anti-aliasing.
+        bool antialias = false;
+        //! Whether to draw opaque elements from the topmost one down,
+        //! skipping pixels that are already final (ignored when
+        //! anti-aliasing, since blended pixels are not final).
+        bool front_to_back = false;
+        //! When positive, render and encode the image in horizontal bands
+        //! of this many rows, keeping only one band in memory.
+        int band_rows = 0;
+        //! zlib compression level of the output, from 1 (fastest) to 9
+        //! (smallest).
+        int compression = 6;
+        //! Whether to write an indexed PNG when the image has at most 256
+        //! colors (not available with band_rows, which cannot know the
+        //! colors of later bands).
+        bool palette = false;
+        //! Whether to read the document with the streaming parser, which
+        //! builds elements tag by tag instead of loading a whole DOM.
+        bool streaming = false;
+        //! Whether to read the document through a memory mapping (falls
+        //! back to normal reads when the file cannot be mapped). Implies
+        //! streaming, which parses the mapped pages without copying them.
+        bool mmap_input = false;
+        //! When positive, largest canvas (width times height) accepted;
+        //! larger documents are rejected before any pixel is allocated.
+        unsigned long long max_pixels = 0;
+    };
 
-        // other transformations
-        virtual void translate(const Point &offset) = 0;
-        virtual void rotate(int angle, const Point &origin) = 0;
-        virtual void scale(int factor, const Point &origin) = 0;
+    //! Statistics gathered while rendering a document.
+    struct RenderStats
+    {
+        //! Pixel writes skipped by front-to-back drawing.
+        unsigned long long occluded_writes = 0;
+        //! Bytes of arena memory used by the parsed document.
+        size_t arena_bytes = 0;
     };
 
+    //! Points of a shape (in the document's arena, if it has one).
+    typedef std::vector<Point, ArenaAllocator<Point>> PointList;
+    //! Children of a group (in the document's arena, if it has one).
+    typedef std::vector<SVGElement *, ArenaAllocator<SVGElement *>> ElementList;
+
     // Declaration of namespace functions
-    void readSVG(const std::string &svg_file, Point &dimensions, std::vector<SVGElement *> &svg_elements);
+    // When an arena is given, the elements are allocated in it and must
+    // not be deleted: they are released with the arena.
+    void readSVG(const std::string &svg_file, Point &dimensions, std::vector<SVGElement *> &svg_elements, bool use_mmap = false, Arena *arena = nullptr);
+    void parseSVG(const char *svg_data, size_t size, Point &dimensions, std::vector<SVGElement *> &svg_elements, Arena *arena = nullptr);
+    void streamSVG(const std::string &svg_file, Point &dimensions, std::vector<SVGElement *> &svg_elements, bool use_mmap = false, Arena *arena = nullptr);
+    void streamSVG(const char *svg_data, size_t size, Point &dimensions, std::vector<SVGElement *> &svg_elements, Arena *arena = nullptr);
+    //! Read an SVG file with the parser selected by options.streaming
+    //! and options.mmap_input (as convert does).
+    void loadSVG(const std::string &svg_file, Point &dimensions, std::vector<SVGElement *> &svg_elements, const RenderOptions &options, Arena *arena = nullptr);
+    //! Check that a document's canvas can be rendered.
+    //! Throws std::runtime_error if a dimension is not positive or the
+    //! canvas is too large.
+    //! @param dimensions Canvas size.
+    //! @param source Document name (for the error message).
+    //! @param max_pixels When positive, largest number of pixels accepted.
+    void check_canvas(const Point &dimensions, const std::string &source, unsigned long long max_pixels = 0);
+    BoundingBox drawn_bounds(const SVGElement *element, const PNGImage &img);
+    BoundingBox drawn_bounds(const DisplayList &list, size_t i, const PNGImage &img);
+    RenderStats render(const std::vector<SVGElement *> &svg_elements, PNGImage &img, const RenderOptions &options);
+    RenderStats render(const DisplayList &list, PNGImage &img, const RenderOptions &options);
     void convert(const std::string &svg_file, const std::string &png_file);
+    RenderStats convert(const std::string &svg_file, const std::string &png_file, const RenderOptions &options);
+    std::unique_ptr<PNGImage> convert(const std::string &svg_file, const RenderOptions &options, RenderStats *stats = nullptr);
+    RenderStats convert_buffer(const char *svg_data, size_t size, const PNGSink &sink, const RenderOptions &options);
+    std::vector<unsigned char> convert_buffer(const std::string &svg_text, const RenderOptions &options, RenderStats *stats = nullptr);
 
     class Ellipse : public SVGElement
     {
     public:
         Ellipse(const Color &fill, const Point &center, const Point &radius);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
 
     private:
         Color fill;
@@ -47,10 +141,9 @@ namespace svg
     {
     public:
         Circle(const Color &fill, const Point &center, int radius);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
 
     private:
         Color fill;
@@ -62,10 +155,9 @@ namespace svg
     {
     public:
         Rect(const Color &fill, const Point &corner1, const Point &corner2, const Point &corner3, const Point &corner4);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
 
     private:
         Color fill;
@@ -79,10 +171,9 @@ namespace svg
     {
     public:
         Line(const Color &stroke, const Point &start, const Point &end);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
 
     private:
         Color stroke;
@@ -94,41 +185,59 @@ namespace svg
     {
     public:
         Polyline(const Color &stroke, const std::vector<Point> &points);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        Polyline(const Color &stroke, PointList &&points);
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
 
     private:
         Color stroke;
-        std::vector<Point> points;
+        PointList points;
     };
 
     class Polygon : public SVGElement
     {
     public:
         Polygon(const Color &fill, const std::vector<Point> &points);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        Polygon(const Color &fill, PointList &&points);
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
 
     private:
         Color fill;
-        std::vector<Point> points;
+        PointList points;
     };
 
     class Group : public SVGElement
     {
     public:
-        std::vector<SVGElement*> elements;
-        Group();
+        ElementList elements;
+        Group(Arena *arena = nullptr);
         ~Group();
         void addElement(SVGElement* element);
-        void draw(PNGImage &img) const override;
-        void translate(const Point &offset) override;
-        void rotate(int angle, const Point &origin) override;
-        void scale(int factor, const Point &origin) override;
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
+    };
+
+    //! Instance of shared, immutable geometry (for <use> elements and
+    //! the elements they refer to). The geometry is drawn with the
+    //! transformation of the instance, so any number of instances share
+    //! a single copy.
+    class Instance : public SVGElement
+    {
+    public:
+        Instance(const std::shared_ptr<const SVGElement> &geometry);
+        //! Get the geometry, shared with the other instances of it.
+        //! @return The geometry.
+        const std::shared_ptr<const SVGElement> &shared_geometry() const;
+        void draw(PNGImage &img, const Transform &parent) const override;
+        BoundingBox bounds(const Transform &parent) const override;
+        void compile(DisplayList &list, const Transform &parent) const override;
+
+    private:
+        std::shared_ptr<const SVGElement> geometry;
     };
 
 }
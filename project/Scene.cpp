@@ -0,0 +1,137 @@
+#include "Scene.hpp"
+
+#include <stdexcept>
+
+namespace svg
+{
+    Scene::Scene(const std::string &svg_file, const RenderOptions &options)
+        : options_(options)
+    {
+        options_.front_to_back = false;
+        Point dimensions;
+        // The scene deletes the elements it replaces, so they are kept on
+        // the heap rather than in an arena.
+        loadSVG(svg_file, dimensions, elements_, options_);
+        try
+        {
+            check_canvas(dimensions, svg_file);
+        }
+        catch (...)
+        {
+            for (SVGElement *e : elements_)
+            {
+                delete e;
+            }
+            throw;
+        }
+        image_.reset(new PNGImage(dimensions.x, dimensions.y));
+        image_->set_antialiasing(options_.antialias);
+        for (SVGElement *e : elements_)
+        {
+            bounds_.push_back(drawn_bounds(e, *image_));
+        }
+        invalidate(image_->clip());
+    }
+
+    Scene::~Scene()
+    {
+        for (SVGElement *e : elements_)
+        {
+            delete e;
+        }
+    }
+
+    size_t Scene::size() const
+    {
+        return elements_.size();
+    }
+
+    const SVGElement *Scene::element(size_t i) const
+    {
+        return elements_.at(i);
+    }
+
+    void Scene::update(size_t i, const std::function<void(SVGElement &)> &edit)
+    {
+        SVGElement *e = elements_.at(i);
+        invalidate(bounds_[i]);
+        edit(*e);
+        bounds_[i] = drawn_bounds(e, *image_);
+        invalidate(bounds_[i]);
+    }
+
+    void Scene::replace(size_t i, SVGElement *element)
+    {
+        if (element == nullptr)
+        {
+            throw std::runtime_error("Scene element replaced by null");
+        }
+        invalidate(bounds_.at(i));
+        delete elements_[i];
+        elements_[i] = element;
+        bounds_[i] = drawn_bounds(element, *image_);
+        invalidate(bounds_[i]);
+    }
+
+    void Scene::invalidate(const BoundingBox &box)
+    {
+        BoundingBox merged = box.intersect(image_->clip());
+        if (merged.empty())
+        {
+            return;
+        }
+        // Keep the dirty rectangles disjoint by merging overlapping ones,
+        // so no pixel is redrawn twice.
+        bool grown = true;
+        while (grown)
+        {
+            grown = false;
+            for (size_t i = 0; i < dirty_.size(); i++)
+            {
+                if (dirty_[i].intersects(merged))
+                {
+                    merged = merged.unite(dirty_[i]);
+                    dirty_[i] = dirty_.back();
+                    dirty_.pop_back();
+                    grown = true;
+                    break;
+                }
+            }
+        }
+        dirty_.push_back(merged);
+    }
+
+    const std::vector<BoundingBox> &Scene::dirty() const
+    {
+        return dirty_;
+    }
+
+    const PNGImage &Scene::render()
+    {
+        const Color white = {255, 255, 255};
+        for (const BoundingBox &box : dirty_)
+        {
+            PNGImage region(*image_, box);
+            for (int y = box.min.y; y <= box.max.y; y++)
+            {
+                region.fill_span(y, box.min.x, box.max.x, white);
+            }
+            std::vector<SVGElement *> overlapping;
+            for (size_t i = 0; i < elements_.size(); i++)
+            {
+                if (bounds_[i].intersects(box))
+                {
+                    overlapping.push_back(elements_[i]);
+                }
+            }
+            svg::render(overlapping, region, options_);
+        }
+        dirty_.clear();
+        return *image_;
+    }
+
+    void Scene::save(const std::string &png_file)
+    {
+        render().save(png_file);
+    }
+}
@@ -0,0 +1,73 @@
+//! @file Scene.hpp
+#ifndef __svg_Scene_hpp__
+#define __svg_Scene_hpp__
+
+#include "SVGElements.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Retained scene: a parsed document kept in memory together with its
+    //! rendered image, for documents that are re-rendered after small edits.
+    //! Edits record the old and new bounding boxes of the element as dirty
+    //! rectangles, and render() only redraws the elements overlapping them.
+    class Scene
+    {
+    public:
+        //! Constructor that loads a document.
+        //! @param svg_file SVG file name.
+        //! @param options Rendering options (front_to_back is ignored;
+        //! streaming and mmap_input select the parser as in convert).
+        Scene(const std::string &svg_file, const RenderOptions &options = RenderOptions());
+        //! Destructor.
+        ~Scene();
+        Scene(const Scene &) = delete;
+        Scene &operator=(const Scene &) = delete;
+        //! Get the number of top-level elements.
+        //! @return The number of elements.
+        size_t size() const;
+        //! Get a top-level element.
+        //! @param i Element index, in document order.
+        //! @return The element.
+        const SVGElement *element(size_t i) const;
+        //! Modify a top-level element in place.
+        //! @param i Element index, in document order.
+        //! @param edit Function applied to the element.
+        void update(size_t i, const std::function<void(SVGElement &)> &edit);
+        //! Replace a top-level element.
+        //! Throws std::runtime_error if the element is null.
+        //! @param i Element index, in document order.
+        //! @param element New element (the scene takes ownership).
+        void replace(size_t i, SVGElement *element);
+        //! Mark a region of the image for redrawing.
+        //! @param box Region.
+        void invalidate(const BoundingBox &box);
+        //! Get the regions that the next render() will redraw.
+        //! @return Dirty rectangles (disjoint).
+        const std::vector<BoundingBox> &dirty() const;
+        //! Redraw the dirty regions.
+        //! @return The up-to-date image.
+        const PNGImage &render();
+        //! Render and save the image.
+        //! @param png_file Output file name.
+        void save(const std::string &png_file);
+
+    private:
+        //! Rendering options.
+        RenderOptions options_;
+        //! Top-level elements, in document order.
+        std::vector<SVGElement *> elements_;
+        //! Cached bounding box of each element.
+        std::vector<BoundingBox> bounds_;
+        //! Rendered image.
+        std::unique_ptr<PNGImage> image_;
+        //! Regions to redraw.
+        std::vector<BoundingBox> dirty_;
+    };
+}
+
+#endif
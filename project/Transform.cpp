@@ -0,0 +1,131 @@
+//! @file Transform.cpp
+#include <climits>
+#include <cmath>
+#include "Transform.hpp"
+
+namespace svg
+{
+    namespace
+    {
+        //! Round to the nearest integer (halves upwards), clamped to the
+        //! int range like the coordinates read from a document (NaN gives
+        //! INT_MIN). Unlike lround, this compiles to a few branch-free
+        //! instructions.
+        inline int round_int(double v)
+        {
+            v = std::floor(v + 0.5);
+            return (int)(v > INT_MIN ? (v < INT_MAX ? v : INT_MAX) : INT_MIN);
+        }
+
+        //! Clamp a sum of ints to the int range.
+        inline int clamp_int(long long v)
+        {
+            return v > INT_MAX ? INT_MAX : v < INT_MIN ? INT_MIN : (int)v;
+        }
+
+        //! Check if a value is an int.
+        inline bool is_int(double v)
+        {
+            return v == std::floor(v) && std::fabs(v) <= 0x7fffffff;
+        }
+    }
+
+    Transform Transform::translation(const Point &offset)
+    {
+        Transform t;
+        t.e = offset.x;
+        t.f = offset.y;
+        return t;
+    }
+
+    Transform Transform::rotation(int degrees, const Point &origin)
+    {
+        double s, c;
+        switch (((degrees % 360) + 360) % 360)
+        {
+        case 0:
+            s = 0, c = 1;
+            break;
+        case 90:
+            s = 1, c = 0;
+            break;
+        case 180:
+            s = 0, c = -1;
+            break;
+        case 270:
+            s = -1, c = 0;
+            break;
+        default:
+            double angle = M_PI * degrees / 180.0;
+            s = ::sin(angle);
+            c = ::cos(angle);
+        }
+        Transform t;
+        t.a = c;
+        t.b = s;
+        t.c = -s;
+        t.d = c;
+        t.e = origin.x - c * origin.x + s * origin.y;
+        t.f = origin.y - s * origin.x - c * origin.y;
+        return t;
+    }
+
+    Transform Transform::scaling(int factor, const Point &origin)
+    {
+        Transform t;
+        t.a = factor;
+        t.d = factor;
+        t.e = origin.x - (double)factor * origin.x;
+        t.f = origin.y - (double)factor * origin.y;
+        return t;
+    }
+
+    Transform Transform::operator*(const Transform &o) const
+    {
+        Transform t;
+        t.a = a * o.a + c * o.b;
+        t.b = b * o.a + d * o.b;
+        t.c = a * o.c + c * o.d;
+        t.d = b * o.c + d * o.d;
+        t.e = a * o.e + c * o.f + e;
+        t.f = b * o.e + d * o.f + f;
+        return t;
+    }
+
+    bool Transform::identity() const
+    {
+        return a == 1 && b == 0 && c == 0 && d == 1 && e == 0 && f == 0;
+    }
+
+    double Transform::scale_factor() const
+    {
+        return ::sqrt(::fabs(a * d - b * c));
+    }
+
+    Point Transform::apply(const Point &p) const
+    {
+        return {round_int(a * p.x + c * p.y + e), round_int(b * p.x + d * p.y + f)};
+    }
+
+    void Transform::apply(const Point *in, Point *out, size_t n) const
+    {
+        if (a == 1 && b == 0 && c == 0 && d == 1 && is_int(e) && is_int(f))
+        {
+            // Integer translation: exact in integer arithmetic.
+            int dx = (int)e, dy = (int)f;
+            for (size_t i = 0; i < n; i++)
+            {
+                out[i].x = clamp_int((long long)in[i].x + dx);
+                out[i].y = clamp_int((long long)in[i].y + dy);
+            }
+            return;
+        }
+        // Straight-line loop over the array, so it can be vectorized.
+        for (size_t i = 0; i < n; i++)
+        {
+            double x = in[i].x, y = in[i].y;
+            out[i].x = round_int(a * x + c * y + e);
+            out[i].y = round_int(b * x + d * y + f);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+//! @file Transform.hpp
+#ifndef __svg_Transform_hpp__
+#define __svg_Transform_hpp__
+
+#include "Point.hpp"
+
+#include <cstddef>
+
+namespace svg
+{
+    //! 2D affine transformation, as the matrix(a, b, c, d, e, f) of SVG:
+    //! x' = a x + c y + e, y' = b x + d y + f.
+    //! Transformations are composed exactly (in floating point) and points
+    //! are only rounded to pixels when they are mapped.
+    struct Transform
+    {
+        double a = 1, b = 0, c = 0, d = 1, e = 0, f = 0;
+
+        //! Translation.
+        //! @param offset Translation direction.
+        //! @return The transformation.
+        static Transform translation(const Point &offset);
+        //! Rotation (multiples of 90 degrees are exact).
+        //! @param degrees Degrees of rotation.
+        //! @param origin Rotation origin.
+        //! @return The transformation.
+        static Transform rotation(int degrees, const Point &origin);
+        //! Uniform scaling.
+        //! @param factor Scale amount.
+        //! @param origin Scaling origin.
+        //! @return The transformation.
+        static Transform scaling(int factor, const Point &origin);
+        //! Compose with another transformation.
+        //! @param o Transformation applied first.
+        //! @return This transformation applied after o.
+        Transform operator*(const Transform &o) const;
+        //! Check if the transformation leaves points unchanged.
+        //! @return true if it is the identity.
+        bool identity() const;
+        //! Get the factor by which the transformation scales lengths
+        //! (exact for the rotations, translations and uniform scalings
+        //! that transformations are built from).
+        //! @return The scale factor.
+        double scale_factor() const;
+        //! Map a point, rounding to the nearest pixel (coordinates
+        //! outside the int range are clamped to it).
+        //! @param p Point.
+        //! @return Mapped point.
+        Point apply(const Point &p) const;
+        //! Map an array of points, rounding to the nearest pixel (and
+        //! clamping like apply(const Point &)).
+        //! @param in Points.
+        //! @param out Mapped points (may be the same array as in).
+        //! @param n Number of points.
+        void apply(const Point *in, Point *out, size_t n) const;
+    };
+}
+#endif
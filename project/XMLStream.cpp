@@ -0,0 +1,352 @@
+#include "XMLStream.hpp"
+#include "external/tinyxml2/tinyxml2.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace svg
+{
+    namespace
+    {
+        //! Size of the input buffer used when reading a file.
+        const size_t BUFFER_SIZE = 1 << 16;
+
+        bool is_space(int c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        //! Append a character reference to a string, as UTF-8.
+        void append_utf8(std::string &out, unsigned long cp)
+        {
+            if (cp < 0x80)
+            {
+                out += (char)cp;
+            }
+            else if (cp < 0x800)
+            {
+                out += (char)(0xC0 | (cp >> 6));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                out += (char)(0xE0 | (cp >> 12));
+                out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                out += (char)(0xF0 | (cp >> 18));
+                out += (char)(0x80 | ((cp >> 12) & 0x3F));
+                out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                out += (char)(0x80 | (cp & 0x3F));
+            }
+        }
+
+        //! Decode the entities of an attribute value.
+        //! Unknown entities are kept as they are.
+        void decode(const char *begin, const char *end, std::string &out)
+        {
+            static const struct
+            {
+                const char *name;
+                char value;
+            } ENTITIES[] = {{"lt;", '<'}, {"gt;", '>'}, {"amp;", '&'}, {"quot;", '"'}, {"apos;", '\''}};
+            out.clear();
+            for (const char *p = begin; p < end; p++)
+            {
+                if (*p != '&')
+                {
+                    out += *p;
+                    continue;
+                }
+                const char *semi = (const char *)::memchr(p, ';', end - p);
+                bool decoded = false;
+                if (semi != nullptr && p + 1 < semi && p[1] == '#')
+                {
+                    bool hex = p + 2 < semi && p[2] == 'x';
+                    char *stop = nullptr;
+                    unsigned long cp = std::strtoul(p + (hex ? 3 : 2), &stop, hex ? 16 : 10);
+                    if (stop == semi && cp > 0 && cp <= 0x10FFFF)
+                    {
+                        append_utf8(out, cp);
+                        decoded = true;
+                    }
+                }
+                else if (semi != nullptr)
+                {
+                    for (const auto &e : ENTITIES)
+                    {
+                        size_t len = ::strlen(e.name);
+                        if ((size_t)(semi + 1 - (p + 1)) == len && ::memcmp(p + 1, e.name, len) == 0)
+                        {
+                            out += e.value;
+                            decoded = true;
+                            break;
+                        }
+                    }
+                }
+                if (decoded)
+                {
+                    p = semi;
+                }
+                else
+                {
+                    out += '&';
+                }
+            }
+        }
+    }
+
+    XMLStream::XMLStream(const std::string &file_name)
+        : source_(file_name), file_(::fopen(file_name.c_str(), "rb")), buffer_(BUFFER_SIZE),
+          data_(buffer_.data()), pos_(0), size_(0), attribute_count_(0), self_closing_(false)
+    {
+        if (file_ == nullptr)
+        {
+            throw std::runtime_error("Unable to load " + file_name);
+        }
+    }
+
+    XMLStream::XMLStream(const char *data, size_t size)
+        : source_("SVG document"), file_(nullptr), data_(data), pos_(0), size_(size),
+          attribute_count_(0), self_closing_(false)
+    {
+    }
+
+    XMLStream::~XMLStream()
+    {
+        if (file_ != nullptr)
+        {
+            ::fclose(file_);
+        }
+    }
+
+    int XMLStream::get()
+    {
+        if (pos_ == size_)
+        {
+            if (file_ == nullptr)
+            {
+                return EOF;
+            }
+            size_ = ::fread(buffer_.data(), 1, buffer_.size(), file_);
+            pos_ = 0;
+            if (size_ == 0)
+            {
+                if (::ferror(file_))
+                {
+                    throw std::runtime_error("Unable to load " + source_);
+                }
+                return EOF;
+            }
+        }
+        return (unsigned char)data_[pos_++];
+    }
+
+    void XMLStream::skip_past(const char *terminator)
+    {
+        size_t len = ::strlen(terminator);
+        char window[4] = {0, 0, 0, 0};
+        while (::memcmp(window + sizeof(window) - len, terminator, len) != 0)
+        {
+            int c = get();
+            if (c == EOF)
+            {
+                fail(std::string("missing ") + terminator);
+            }
+            ::memmove(window, window + 1, sizeof(window) - 1);
+            window[sizeof(window) - 1] = (char)c;
+        }
+    }
+
+    [[noreturn]] void XMLStream::fail(const std::string &what) const
+    {
+        throw std::runtime_error(source_ + ": malformed XML (" + what + ")");
+    }
+
+    XMLStream::Event XMLStream::next()
+    {
+        for (;;)
+        {
+            // Skip text up to the next markup.
+            int c;
+            while ((c = get()) != '<')
+            {
+                if (c == EOF)
+                {
+                    return DONE;
+                }
+            }
+            c = get();
+            if (c == '?')
+            {
+                skip_past("?>");
+                continue;
+            }
+            if (c == '!')
+            {
+                c = get();
+                if (c == '-')
+                {
+                    if (get() != '-')
+                    {
+                        fail("bad comment");
+                    }
+                    skip_past("-->");
+                }
+                else if (c == '[')
+                {
+                    skip_past("]]>");
+                }
+                else
+                {
+                    // DOCTYPE, possibly with an internal subset in brackets.
+                    int depth = 0;
+                    for (; c != '>' || depth > 0; c = get())
+                    {
+                        if (c == EOF)
+                        {
+                            fail("unterminated declaration");
+                        }
+                        depth += c == '[' ? 1 : c == ']' ? -1 : 0;
+                    }
+                }
+                continue;
+            }
+            tag_.clear();
+            char quote = 0;
+            for (; c != '>' || quote != 0; c = get())
+            {
+                if (c == EOF)
+                {
+                    fail("unterminated tag");
+                }
+                if (quote == 0 && (c == '"' || c == '\''))
+                {
+                    quote = (char)c;
+                }
+                else if (c == quote)
+                {
+                    quote = 0;
+                }
+                tag_ += (char)c;
+            }
+            parse_tag();
+            return tag_[0] == '/' ? END : START;
+        }
+    }
+
+    void XMLStream::parse_tag()
+    {
+        const char *p = tag_.c_str(), *end = p + tag_.size();
+        bool closing = *p == '/';
+        if (closing)
+        {
+            p++;
+        }
+        const char *name = p;
+        while (p < end && !is_space(*p) && *p != '/')
+        {
+            p++;
+        }
+        if (p == name)
+        {
+            fail("tag without a name");
+        }
+        name_.assign(name, p);
+        attribute_count_ = 0;
+        self_closing_ = false;
+        for (;;)
+        {
+            while (p < end && is_space(*p))
+            {
+                p++;
+            }
+            if (p == end)
+            {
+                break;
+            }
+            if (*p == '/' && p + 1 == end && !closing)
+            {
+                self_closing_ = true;
+                break;
+            }
+            if (closing)
+            {
+                fail("unexpected content in end tag </" + name_ + ">");
+            }
+            const char *attr = p;
+            while (p < end && !is_space(*p) && *p != '=')
+            {
+                p++;
+            }
+            const char *attr_end = p;
+            while (p < end && is_space(*p))
+            {
+                p++;
+            }
+            if (attr == attr_end || p == end || *p != '=')
+            {
+                fail("bad attribute in <" + name_ + ">");
+            }
+            p++;
+            while (p < end && is_space(*p))
+            {
+                p++;
+            }
+            if (p == end || (*p != '"' && *p != '\''))
+            {
+                fail("unquoted attribute in <" + name_ + ">");
+            }
+            const char *value = p + 1;
+            const char *value_end = (const char *)::memchr(value, *p, end - value);
+            if (value_end == nullptr)
+            {
+                fail("unterminated attribute in <" + name_ + ">");
+            }
+            if (attribute_count_ == attributes_.size())
+            {
+                attributes_.emplace_back();
+            }
+            std::pair<std::string, std::string> &a = attributes_[attribute_count_++];
+            a.first.assign(attr, attr_end);
+            decode(value, value_end, a.second);
+            p = value_end + 1;
+        }
+    }
+
+    const std::string &XMLStream::name() const
+    {
+        return name_;
+    }
+
+    bool XMLStream::self_closing() const
+    {
+        return self_closing_;
+    }
+
+    const char *XMLStream::attribute(const char *name) const
+    {
+        for (size_t i = 0; i < attribute_count_; i++)
+        {
+            if (attributes_[i].first == name)
+            {
+                return attributes_[i].second.c_str();
+            }
+        }
+        return nullptr;
+    }
+
+    int XMLStream::int_attribute(const char *name) const
+    {
+        const char *value = attribute(name);
+        int i = 0;
+        if (value != nullptr)
+        {
+            tinyxml2::XMLUtil::ToInt(value, &i);
+        }
+        return i;
+    }
+}
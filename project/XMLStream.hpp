@@ -0,0 +1,96 @@
+//! @file XMLStream.hpp
+#ifndef __svg_XMLStream_hpp__
+#define __svg_XMLStream_hpp__
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace svg
+{
+    //! Pull parser reading the tags of an XML document one at a time.
+    //! Only the current tag is kept in memory (the input is read through
+    //! a fixed-size buffer), so documents of any size can be scanned.
+    //! Text, comments, processing instructions, CDATA sections and the
+    //! DOCTYPE declaration are skipped.
+    class XMLStream
+    {
+    public:
+        //! Kind of item returned by next().
+        enum Event
+        {
+            START, //!< Start tag (possibly self-closing).
+            END,   //!< End tag.
+            DONE   //!< End of the document.
+        };
+        //! Constructor that opens a file.
+        //! @param file_name File name.
+        XMLStream(const std::string &file_name);
+        //! Constructor reading from memory.
+        //! The data must stay valid while the stream is used.
+        //! @param data Document contents.
+        //! @param size Size of the contents.
+        XMLStream(const char *data, size_t size);
+        //! Destructor.
+        ~XMLStream();
+        XMLStream(const XMLStream &) = delete;
+        XMLStream &operator=(const XMLStream &) = delete;
+        //! Read the next tag.
+        //! Throws std::runtime_error on malformed input.
+        //! @return What was read.
+        Event next();
+        //! Get the name of the current tag.
+        //! @return The tag name.
+        const std::string &name() const;
+        //! Check whether the current start tag is self-closing (<a/>).
+        //! @return Whether it is.
+        bool self_closing() const;
+        //! Get an attribute of the current start tag, with entities decoded.
+        //! @param name Attribute name.
+        //! @return The value, or nullptr if the tag does not have it.
+        const char *attribute(const char *name) const;
+        //! Get an integer attribute of the current start tag (parsed like
+        //! tinyxml2 does).
+        //! @param name Attribute name.
+        //! @return The value, or 0 if absent or not a number.
+        int int_attribute(const char *name) const;
+
+    private:
+        //! Get the next input character.
+        //! @return The character, or EOF at the end of the input.
+        int get();
+        //! Skip input up to and including a terminator.
+        //! @param terminator Terminating string (at most 4 characters).
+        void skip_past(const char *terminator);
+        //! Split the current tag text into a name and attributes.
+        void parse_tag();
+        //! Throw an error about malformed input.
+        //! @param what Description of the problem.
+        [[noreturn]] void fail(const std::string &what) const;
+
+        //! Input name (for error messages).
+        std::string source_;
+        //! Input file (null when reading from memory).
+        FILE *file_;
+        //! Input buffer (owned when reading a file).
+        std::vector<char> buffer_;
+        //! Current input data.
+        const char *data_;
+        //! Position in the current input data.
+        size_t pos_;
+        //! Size of the current input data.
+        size_t size_;
+        //! Text of the current tag, between '<' and '>'.
+        std::string tag_;
+        //! Name of the current tag.
+        std::string name_;
+        //! Attributes of the current tag (name, decoded value).
+        std::vector<std::pair<std::string, std::string>> attributes_;
+        //! Number of attributes of the current tag (attributes_ is reused).
+        size_t attribute_count_;
+        //! Whether the current tag is self-closing.
+        bool self_closing_;
+    };
+}
+#endif
@@ -1,23 +1,188 @@
 #include <string>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
 #include "SVGElements.hpp"
+#include "Converter.hpp"
+#include "PNGWriter.hpp"
 
 namespace svg
 {
-    void convert(const std::string &svg_file, const std::string &png_file)
+    //! Side of the square screen tiles used by the parallel renderer.
+    const int TILE_SIZE = 64;
+
+    void check_canvas(const Point &dimensions, const std::string &source, unsigned long long max_pixels)
+    {
+        if (dimensions.x <= 0 || dimensions.y <= 0 ||
+            (max_pixels > 0 && (unsigned long long)dimensions.x * dimensions.y > max_pixels))
+        {
+            throw std::runtime_error(source + ": invalid canvas size " + std::to_string(dimensions.x) + "x" +
+                                     std::to_string(dimensions.y));
+        }
+    }
+
+    BoundingBox drawn_bounds(const SVGElement *element, const PNGImage &img)
+    {
+        BoundingBox box = element->bounds();
+        if (box.empty() || !img.antialiasing())
+        {
+            return box;
+        }
+        // Anti-aliased edges may reach past an element's bounding box
+        // (by at most the 2 pixel miter limit of polygon outlines).
+        return {box.min.translate({-2, -2}), box.max.translate({2, 2})};
+    }
+
+    BoundingBox drawn_bounds(const DisplayList &list, size_t i, const PNGImage &img)
+    {
+        const BoundingBox &box = list.bounds(i);
+        if (box.empty() || !img.antialiasing())
+        {
+            return box;
+        }
+        return {box.min.translate({-2, -2}), box.max.translate({2, 2})};
+    }
+
+    //! Render a display list concurrently, one screen tile at a time.
+    //! Each command is binned into every tile its bounding box touches;
+    //! a tile draws its commands in document order through a view
+    //! clipped to the tile, so the result matches serial rendering.
+    static void render_tiles(const DisplayList &list, PNGImage &img, int threads)
+    {
+        // Tiles cover the clip box, on a grid aligned to the image origin.
+        const BoundingBox &clip = img.clip();
+        if (clip.empty())
+        {
+            return;
+        }
+        int tx0 = clip.min.x / TILE_SIZE, ty0 = clip.min.y / TILE_SIZE;
+        int tiles_x = clip.max.x / TILE_SIZE - tx0 + 1;
+        int tiles_y = clip.max.y / TILE_SIZE - ty0 + 1;
+        std::vector<std::vector<uint32_t>> bins(tiles_x * tiles_y);
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            BoundingBox box = drawn_bounds(list, i, img).intersect(clip);
+            if (box.empty())
+            {
+                continue;
+            }
+            for (int ty = box.min.y / TILE_SIZE; ty <= box.max.y / TILE_SIZE; ty++)
+            {
+                for (int tx = box.min.x / TILE_SIZE; tx <= box.max.x / TILE_SIZE; tx++)
+                {
+                    bins[(ty - ty0) * tiles_x + (tx - tx0)].push_back((uint32_t)i);
+                }
+            }
+        }
+
+        std::atomic<int> next_tile(0);
+        auto worker = [&]()
+        {
+            int t;
+            while ((t = next_tile++) < (int)bins.size())
+            {
+                if (bins[t].empty())
+                {
+                    continue;
+                }
+                Point corner = {(tx0 + t % tiles_x) * TILE_SIZE, (ty0 + t / tiles_x) * TILE_SIZE};
+                PNGImage tile(img, {corner, corner.translate({TILE_SIZE - 1, TILE_SIZE - 1})});
+                if (tile.front_to_back())
+                {
+                    for (auto it = bins[t].rbegin(); it != bins[t].rend(); ++it)
+                    {
+                        list.draw(*it, tile);
+                    }
+                }
+                else
+                {
+                    for (uint32_t i : bins[t])
+                    {
+                        list.draw(i, tile);
+                    }
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; i++)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &th : pool)
+        {
+            th.join();
+        }
+    }
+
+    RenderStats render(const std::vector<SVGElement *> &svg_elements, PNGImage &img, const RenderOptions &options)
+    {
+        return render(DisplayList(svg_elements), img, options);
+    }
+
+    RenderStats render(const DisplayList &list, PNGImage &img, const RenderOptions &options)
     {
-        Point dimensions;
-        std::vector<SVGElement *> svg_elements;
-        readSVG(svg_file, dimensions, svg_elements);
-        PNGImage img(dimensions.x, dimensions.y);
-        for (SVGElement* e : svg_elements)
+        img.set_antialiasing(options.antialias);
+        img.set_front_to_back(options.front_to_back && !options.antialias);
+        if (options.threads > 1)
         {
-            e->draw(img);
+            render_tiles(list, img, options.threads);
         }
-        img.save(png_file);
-        for (SVGElement* e  : svg_elements)
+        else
+        {
+            // Commands entirely outside the canvas are not rasterized.
+            size_t n = list.size();
+            bool reverse = img.front_to_back();
+            for (size_t k = 0; k < n; k++)
+            {
+                size_t i = reverse ? n - 1 - k : k;
+                if (drawn_bounds(list, i, img).intersects(img.clip()))
+                {
+                    list.draw(i, img);
+                }
+            }
+        }
+        RenderStats stats;
+        stats.occluded_writes = img.occluded_writes();
+        img.set_front_to_back(false);
+        return stats;
+    }
+
+    void convert(const std::string &svg_file, const std::string &png_file)
+    {
+        convert(svg_file, png_file, RenderOptions());
+    }
+
+    RenderStats convert(const std::string &svg_file, const std::string &png_file, const RenderOptions &options)
+    {
+        return Converter().convert(svg_file, png_file, options);
+    }
+
+    std::unique_ptr<PNGImage> convert(const std::string &svg_file, const RenderOptions &options, RenderStats *stats)
+    {
+        Converter converter;
+        converter.render(svg_file, options, stats);
+        return converter.release_image();
+    }
+
+    RenderStats convert_buffer(const char *svg_data, size_t size, const PNGSink &sink, const RenderOptions &options)
+    {
+        return Converter().convert_buffer(svg_data, size, sink, options);
+    }
+
+    std::vector<unsigned char> convert_buffer(const std::string &svg_text, const RenderOptions &options, RenderStats *stats)
+    {
+        std::vector<unsigned char> png;
+        RenderStats s = convert_buffer(svg_text.data(), svg_text.size(), [&png](const unsigned char *data, size_t len)
+        {
+            png.insert(png.end(), data, data + len);
+        }, options);
+        if (stats != nullptr)
         {
-            delete e;
+            *stats = s;
         }
+        return png;
     }
-}
\ No newline at end of file
+}
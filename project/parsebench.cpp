@@ -0,0 +1,86 @@
+#include "SVGElements.hpp"
+#include "Color.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    //! Color values timed by the parse_color benchmark: names in both
+    //! cases, short and long hex, and rgb() with numbers and percentages.
+    const char *const COLORS[] = {"red", "CornflowerBlue", "lightgoldenrodyellow", " navy ",
+                                  "#f80", "#1e90ff", "rgb(255, 128, 0)", "rgb(10%,20%,30%)"};
+
+    //! Time repeated calls of a function.
+    //! @param iterations Number of calls.
+    //! @param f Function.
+    //! @return Mean time of a call, in microseconds.
+    template <class F>
+    double mean_micros(int iterations, F f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            f();
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / iterations;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 100;
+    int arg = 1;
+    if (arg + 1 < argc && ::strcmp(argv[arg], "-n") == 0)
+    {
+        iterations = std::atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if (iterations <= 0 || arg == argc)
+    {
+        std::cout << "Usage: parsebench [-n iterations] file.svg..." << std::endl;
+        return 1;
+    }
+    for (; arg < argc; arg++)
+    {
+        std::cout << argv[arg] << ":";
+        svg::RenderOptions dom, streaming, mapped;
+        streaming.streaming = true;
+        mapped.mmap_input = true;
+        const char *names[] = {"DOM", "streaming", "mmap"};
+        const svg::RenderOptions *parsers[] = {&dom, &streaming, &mapped};
+        for (int i = 0; i < 3; i++)
+        {
+            svg::Point dimensions;
+            std::vector<svg::SVGElement *> elements;
+            svg::Arena arena;
+            double micros = mean_micros(iterations, [&]
+                                        {
+                                            elements.clear();
+                                            arena.reset();
+                                            svg::loadSVG(argv[arg], dimensions, elements, *parsers[i], &arena);
+                                        });
+            std::cout << " " << names[i] << " " << micros << " us";
+        }
+        std::cout << std::endl;
+    }
+    // Enough calls per iteration to measure a lookup of a few nanoseconds.
+    const int COLOR_REPEATS = 1000;
+    const size_t color_count = sizeof(COLORS) / sizeof(COLORS[0]);
+    volatile unsigned sum = 0;
+    double micros = mean_micros(iterations, [&]
+                                {
+                                    for (int r = 0; r < COLOR_REPEATS; r++)
+                                    {
+                                        for (const char *text : COLORS)
+                                        {
+                                            svg::Color c = svg::parse_color(text);
+                                            sum = sum + c.red + c.green + c.blue;
+                                        }
+                                    }
+                                });
+    std::cout << "parse_color: " << micros * 1e3 / (COLOR_REPEATS * color_count) << " ns per color" << std::endl;
+    return 0;
+}
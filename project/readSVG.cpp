@@ -1,8 +1,12 @@
 #include <iostream>
-#include <sstream>
 #include <algorithm>
+#include <climits>
+#include <memory>
+#include <unordered_map>
 #include "SVGElements.hpp"
 #include "external/tinyxml2/tinyxml2.h"
+#include "XMLStream.hpp"
+#include "MappedFile.hpp"
 #include "Color.hpp"
 
 using namespace std;
@@ -17,203 +21,483 @@ namespace svg {
         return p;
     }
 
-    void apply_transformations(SVGElement* element, const string& transform, const Point& origin) {
-        istringstream ss(transform);
-        string operation;
-
-        while (ss >> operation) {
-            if(operation.find("translate") != string::npos) {
-                int x, y;
-                sscanf(transform.c_str(), "translate(%d %d)", &x, &y);
-                element->translate(create_point(x, y));
-            } else if (operation.find("rotate") != string::npos) {
-                int angle;
-                sscanf(operation.c_str(), "rotate(%d)", &angle);
-                element->rotate(angle, origin);
-            } else if (operation.find("scale") != string::npos) {
-                int factor;
-                sscanf(operation.c_str(), "scale(%d)", &factor);
-                element->scale(factor, origin);
+    // Read the next number of an attribute value, skipping SVG separators
+    // (whitespace and commas) before it: [sign] digits [. digits]
+    // [e [sign] digits]. A sign or a second '.' starts a new number, as in
+    // "10-5" or "1.5.5". Advances p past the number; returns false (with p
+    // at the first unexpected character) when there is no number.
+    static bool next_number(const char*& p, double& value) {
+        static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                       1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+        while (*p == ' ' || *p == ',' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+        const char* start = p;
+        bool negative = *p == '-';
+        if (*p == '-' || *p == '+') {
+            p++;
+        }
+        // Up to 18 significant digits are accumulated exactly.
+        unsigned long long mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 18) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa > 0;
+            } else {
+                exponent++;
             }
         }
+        if (*p == '.') {
+            p++;
+            for (; *p >= '0' && *p <= '9'; p++, any = true) {
+                if (digits < 18) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa > 0;
+                    exponent--;
+                }
+            }
+        }
+        if (!any) {
+            p = start;
+            return false;
+        }
+        if (*p == 'e' || *p == 'E') {
+            const char* e = p++;
+            bool negative_exp = *p == '-';
+            if (*p == '-' || *p == '+') {
+                p++;
+            }
+            if (*p >= '0' && *p <= '9') {
+                int exp = 0;
+                for (; *p >= '0' && *p <= '9'; p++) {
+                    exp = min(exp * 10 + (*p - '0'), 1000);
+                }
+                exponent += negative_exp ? -exp : exp;
+            } else {
+                p = e;
+            }
+        }
+        double v = (double)mantissa;
+        for (; exponent > 18; exponent -= 18) {
+            v *= POW10[18];
+        }
+        for (; exponent < -18; exponent += 18) {
+            v /= POW10[18];
+        }
+        v = exponent >= 0 ? v * POW10[exponent] : v / POW10[-exponent];
+        value = negative ? -v : v;
+        return true;
     }
 
-    void parse_element(XMLElement* xml_elem, vector<SVGElement*>& svg_elements) {
-        const char* value = xml_elem->Value();
+    // Integer coordinate of a number (truncated, like IntAttribute)
+    static int to_int(double v) {
+        return v >= INT_MAX ? INT_MAX : v <= INT_MIN ? INT_MIN : (int)v;
+    }
+
+    // Apply an SVG transform list ("translate(x [y])", "rotate(a [cx cy])",
+    // "scale(s)", separated by whitespace or commas). The rightmost
+    // transform is applied first, as in SVG, so each one is applied after
+    // the rest of the list; unknown or malformed transforms end the list.
+    static void apply_transformations(SVGElement* element, const char* transform, const Point& origin) {
+        const char* p = transform;
+        while (*p == ' ' || *p == ',' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+        const char* name = p;
+        while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+            p++;
+        }
+        size_t name_len = p - name;
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+        if (name_len == 0 || *p != '(') {
+            return;
+        }
+        p++;
+        double args[6];
+        int count = 0;
+        double value;
+        while (count < 6 && next_number(p, value)) {
+            args[count++] = value;
+        }
+        while (*p == ' ' || *p == ',' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+        if (*p != ')' || count == 0) {
+            return;
+        }
+        apply_transformations(element, p + 1, origin);
+        if (name_len == 9 && strncmp(name, "translate", 9) == 0) {
+            element->translate(create_point(to_int(args[0]), count > 1 ? to_int(args[1]) : 0));
+        } else if (name_len == 6 && strncmp(name, "rotate", 6) == 0) {
+            Point center = origin;
+            if (count >= 3) {
+                center = create_point(origin.x + to_int(args[1]), origin.y + to_int(args[2]));
+            }
+            element->rotate(to_int(args[0]), center);
+        } else if (name_len == 5 && strncmp(name, "scale", 5) == 0) {
+            element->scale(to_int(args[0]), origin);
+        }
+    }
+
+    // Attribute access for the two document sources
+    static const char* attribute(const XMLElement* xml_elem, const char* name) {
+        return xml_elem->Attribute(name);
+    }
+    static int int_attribute(const XMLElement* xml_elem, const char* name) {
+        return xml_elem->IntAttribute(name);
+    }
+    static const char* attribute(const XMLStream& xml, const char* name) {
+        return xml.attribute(name);
+    }
+    static int int_attribute(const XMLStream& xml, const char* name) {
+        return xml.int_attribute(name);
+    }
+
+    // Allocate an element in the document's arena, or on the heap
+    template <class T, class... Args>
+    static T* make(Arena* arena, Args&&... args) {
+        if (arena) {
+            return arena->create<T>(std::forward<Args>(args)...);
+        }
+        return new T(std::forward<Args>(args)...);
+    }
+
+    static PointList parse_points(const char* pointsStr, Arena* arena) {
+        PointList points{ArenaAllocator<Point>(arena)};
+        if (!pointsStr) {
+            return points;
+        }
+        // Count the coordinates first so the vector is allocated once.
+        size_t count = 0;
+        double x, y;
+        const char* p = pointsStr;
+        while (next_number(p, x)) {
+            count++;
+        }
+        points.reserve(count / 2);
+        for (p = pointsStr; next_number(p, x) && next_number(p, y);) {
+            points.push_back(create_point(to_int(x), to_int(y)));
+        }
+        return points;
+    }
+
+    // Create the shape described by a tag (nullptr if it is not a shape)
+    template <class Source>
+    static SVGElement* make_shape(const char* value, const Source& src, Arena* arena) {
         SVGElement* element = nullptr;
         if (strcmp(value, "ellipse") == 0) {
-            int cx = xml_elem->IntAttribute("cx");
-            int cy = xml_elem->IntAttribute("cy");
-            int rx = xml_elem->IntAttribute("rx");
-            int ry = xml_elem->IntAttribute("ry");
-            const char* fillStr = xml_elem->Attribute("fill");
+            int cx = int_attribute(src, "cx");
+            int cy = int_attribute(src, "cy");
+            int rx = int_attribute(src, "rx");
+            int ry = int_attribute(src, "ry");
+            const char* fillStr = attribute(src, "fill");
             Color fill = parse_color(fillStr ? fillStr : "");
-            element = new Ellipse(fill, create_point(cx, cy), create_point(rx, ry));
+            element = make<Ellipse>(arena, fill, create_point(cx, cy), create_point(rx, ry));
         } else if (strcmp(value, "circle") == 0) {
-            int cx = xml_elem->IntAttribute("cx");
-            int cy = xml_elem->IntAttribute("cy");
-            int r = xml_elem->IntAttribute("r");
-            const char* fillStr = xml_elem->Attribute("fill");
+            int cx = int_attribute(src, "cx");
+            int cy = int_attribute(src, "cy");
+            int r = int_attribute(src, "r");
+            const char* fillStr = attribute(src, "fill");
             Color fill = parse_color(fillStr ? fillStr : "");
-            element = new Circle(fill, create_point(cx, cy), r);
+            element = make<Circle>(arena, fill, create_point(cx, cy), r);
         } else if (strcmp(value, "polyline") == 0) {
-            vector<Point> points;
-            const char* pointsStr = xml_elem->Attribute("points");
-            istringstream pointsStream(pointsStr);
-            string point;
-            while (getline(pointsStream, point, ' ')) {
-                replace(point.begin(), point.end(), ',', ' ');
-                istringstream pointStream(point);
-                int x, y;
-                pointStream >> x >> y;
-                points.push_back(create_point(x, y));
-            }
-            const char* strokeStr = xml_elem->Attribute("stroke");
+            PointList points = parse_points(attribute(src, "points"), arena);
+            const char* strokeStr = attribute(src, "stroke");
             Color stroke = parse_color(strokeStr ? strokeStr : "");
-            element = new Polyline(stroke, points);
+            element = make<Polyline>(arena, stroke, std::move(points));
         } else if (strcmp(value, "line") == 0) {
-            int x1 = xml_elem->IntAttribute("x1");
-            int y1 = xml_elem->IntAttribute("y1");
-            int x2 = xml_elem->IntAttribute("x2");
-            int y2 = xml_elem->IntAttribute("y2");
-            const char* strokeStr = xml_elem->Attribute("stroke");
+            int x1 = int_attribute(src, "x1");
+            int y1 = int_attribute(src, "y1");
+            int x2 = int_attribute(src, "x2");
+            int y2 = int_attribute(src, "y2");
+            const char* strokeStr = attribute(src, "stroke");
             Color stroke = parse_color(strokeStr ? strokeStr : "");
-            element = new Line(stroke, create_point(x1, y1), create_point(x2, y2));
+            element = make<Line>(arena, stroke, create_point(x1, y1), create_point(x2, y2));
         } else if (strcmp(value, "polygon") == 0) {
-            vector<Point> points;
-            const char* pointsStr = xml_elem->Attribute("points");
-            istringstream pointsStream(pointsStr);
-            string point;
-            while (getline(pointsStream, point, ' ')) {
-                replace(point.begin(), point.end(), ',', ' ');
-                istringstream pointStream(point);
-                int x, y;
-                pointStream >> x >> y;
-                points.push_back(create_point(x, y));
-            }
-            const char* fillStr = xml_elem->Attribute("fill");
+            PointList points = parse_points(attribute(src, "points"), arena);
+            const char* fillStr = attribute(src, "fill");
             Color fill = parse_color(fillStr ? fillStr : "");
-            element = new Polygon(fill, points);
+            element = make<Polygon>(arena, fill, std::move(points));
         } else if (strcmp(value, "rect") == 0) {
-            int x = xml_elem->IntAttribute("x");
-            int y = xml_elem->IntAttribute("y");
-            int width = xml_elem->IntAttribute("width");
-            int height = xml_elem->IntAttribute("height");
-            const char* fillStr = xml_elem->Attribute("fill");
+            int x = int_attribute(src, "x");
+            int y = int_attribute(src, "y");
+            int width = int_attribute(src, "width");
+            int height = int_attribute(src, "height");
+            const char* fillStr = attribute(src, "fill");
             Color fill = parse_color(fillStr ? fillStr : "");
-            element = new Rect(fill, create_point(x, y), width, height);
-        } else if (strcmp(value, "g") == 0) {
-            Group* group = new Group();
+            element = make<Rect>(arena, fill, create_point(x, y), create_point(x + width-1, y), create_point(x + width-1, y + height-1), create_point(x, y + height-1));
+        }
+        return element;
+    }
+
+    static void transform_element(SVGElement* element, const char* transform, const char* transform_origin) {
+        if (transform) {
+            double x = 0, y = 0;
+            if (transform_origin && next_number(transform_origin, x)) {
+                next_number(transform_origin, y);
+            }
+            apply_transformations(element, transform, create_point(to_int(x), to_int(y)));
+        }
+    }
+
+    // Apply the transform attribute of a tag (if any) to an element
+    template <class Source>
+    static void transform_element(SVGElement* element, const Source& src) {
+        transform_element(element, attribute(src, "transform"), attribute(src, "transform-origin"));
+    }
+
+    // Elements with an id, as shared geometry for <use> instances
+    typedef unordered_map<string, shared_ptr<const SVGElement>> ElementRegistry;
+
+    // Create the instance for a <use> tag (nullptr if the reference is unknown)
+    template <class Source>
+    static SVGElement* make_use(const Source& src, const ElementRegistry& ids, Arena* arena) {
+        const char* href = attribute(src, "href");
+        if (!href) {
+            href = attribute(src, "xlink:href");
+        }
+        if (!href || href[0] != '#') {
+            return nullptr;
+        }
+        auto it = ids.find(href + 1);
+        if (it == ids.end()) {
+            return nullptr;
+        }
+        Instance* instance = make<Instance>(arena, it->second);
+        int x = int_attribute(src, "x");
+        int y = int_attribute(src, "y");
+        if (x != 0 || y != 0) {
+            instance->translate(create_point(x, y));
+        }
+        return instance;
+    }
+
+    // Register a complete element that has an id (with its own transform
+    // applied, but not those of its ancestors): the registry keeps the
+    // element as immutable geometry and the document gets an instance of it,
+    // so later transforms never modify what <use> elements share.
+    static SVGElement* register_element(SVGElement* element, const char* id, ElementRegistry& ids, Arena* arena) {
+        if (!id) {
+            return element;
+        }
+        shared_ptr<const SVGElement> geometry;
+        if (arena) {
+            // The arena owns the geometry, and holds the reference count.
+            geometry = shared_ptr<const SVGElement>(element, [](const SVGElement*) {}, ArenaAllocator<SVGElement>(arena));
+        } else {
+            geometry = shared_ptr<const SVGElement>(element);
+        }
+        ids.emplace(id, geometry);
+        return make<Instance>(arena, geometry);
+    }
+
+    static SVGElement* parse_element(XMLElement* xml_elem, ElementRegistry& ids, Arena* arena) {
+        const char* value = xml_elem->Value();
+        SVGElement* element = make_shape(value, xml_elem, arena);
+        if (strcmp(value, "g") == 0) {
+            Group* group = make<Group>(arena, arena);
+            size_t count = 0;
             for (XMLElement* child = xml_elem->FirstChildElement(); child; child = child->NextSiblingElement()) {
-                parse_element(child, group->elements);
+                count++;
             }
-            const char* transform = xml_elem->Attribute("transform");
-            const char* transform_origin = xml_elem->Attribute("transform-origin");
-            Point origin = transform_origin ? create_point(atoi(transform_origin), atoi(strchr(transform_origin, ' ') + 1)) : create_point(0, 0);
-            if (transform) {
-                apply_transformations(group, transform, origin);
+            group->elements.reserve(count);
+            for (XMLElement* child = xml_elem->FirstChildElement(); child; child = child->NextSiblingElement()) {
+                if (SVGElement* e = parse_element(child, ids, arena)) {
+                    group->elements.push_back(e);
+                }
             }
             element = group;
+        } else if (strcmp(value, "use") == 0) {
+            element = make_use(xml_elem, ids, arena);
         }
 
         if (element) {
-            const char* transform = xml_elem->Attribute("transform");
-            const char* transform_origin = xml_elem->Attribute("transform-origin");
-            Point origin = transform_origin ? create_point(atoi(transform_origin), atoi(strchr(transform_origin, ' ') + 1)) : create_point(0, 0);
-            if (transform) {
-                apply_transformations(element, transform, origin);
-            }
-            svg_elements.push_back(element);
+            transform_element(element, xml_elem);
+            element = register_element(element, xml_elem->Attribute("id"), ids, arena);
         }
+        return element;
     }
 
-    void readSVG(const string& svg_file, Point& dimensions, vector<SVGElement*>& svg_elements) {
-        XMLDocument doc;
-        XMLError r = doc.LoadFile(svg_file.c_str());
-        if (r != XML_SUCCESS) {
-            throw runtime_error("Unable to load " + svg_file);
-        }
+    static void read_document(XMLDocument& doc, Point& dimensions, vector<SVGElement*>& svg_elements, Arena* arena) {
         XMLElement* xml_elem = doc.RootElement();
 
         dimensions.x = xml_elem->IntAttribute("width");
         dimensions.y = xml_elem->IntAttribute("height");
 
         // Parse child elements
+        ElementRegistry ids;
         for (XMLElement* child = xml_elem->FirstChildElement(); child; child = child->NextSiblingElement()) {
-            const char* value = child->Value();
-            SVGElement* element = nullptr;
-            if (strcmp(value, "ellipse") == 0) {
-                int cx = child->IntAttribute("cx");
-                int cy = child->IntAttribute("cy");
-                int rx = child->IntAttribute("rx");
-                int ry = child->IntAttribute("ry");
-                const char* fillStr = child->Attribute("fill");
-                Color fill = parse_color(fillStr ? fillStr : "");
-                element = new Ellipse(fill, create_point(cx, cy), create_point(rx, ry));
-            } else if (strcmp(value, "circle") == 0) {
-                int cx = child->IntAttribute("cx");
-                int cy = child->IntAttribute("cy");
-                int r = child->IntAttribute("r");
-                const char* fillStr = child->Attribute("fill");
-                Color fill = parse_color(fillStr ? fillStr : "");
-                element = new Circle(fill, create_point(cx, cy), r);
-            } else if (strcmp(value, "polyline") == 0) {
-                vector<Point> points;
-                const char* pointsStr = child->Attribute("points");
-                istringstream pointsStream(pointsStr);
-                string point;
-                while (getline(pointsStream, point, ' ')) {
-                    replace(point.begin(), point.end(), ',', ' ');
-                    istringstream pointStream(point);
-                    int x, y;
-                    pointStream >> x >> y;
-                    points.push_back(create_point(x, y));
+            if (SVGElement* e = parse_element(child, ids, arena)) {
+                svg_elements.push_back(e);
+            }
+        }
+    }
+
+    static void stream_document(XMLStream& xml, Point& dimensions, vector<SVGElement*>& svg_elements, Arena* arena) {
+        // One entry per open tag. Groups collect their children and get
+        // their own transform when closed, after all children were added
+        // (as when reading the DOM), and are then added to their parent;
+        // tags other than the root and groups have no children.
+        struct OpenTag {
+            string name;
+            bool container;
+            Group* group;
+            // Group transform and id attributes, kept until the group is
+            // closed
+            bool has_transform, has_origin, has_id;
+            string transform, transform_origin, id;
+        };
+        ElementRegistry ids;
+        vector<OpenTag> open;
+        bool root_seen = false;
+        size_t first_new = svg_elements.size();
+        // Add an element to the innermost open tag
+        auto add = [&](SVGElement* element) {
+            if (open.back().group) {
+                open.back().group->elements.push_back(element);
+            } else {
+                svg_elements.push_back(element);
+            }
+        };
+        // Finish a group: apply its transform, then add it to its parent
+        auto close = [&](Group* group, const char* transform, const char* transform_origin, const char* id) {
+            transform_element(group, transform, transform_origin);
+            add(register_element(group, id, ids, arena));
+        };
+        try {
+            XMLStream::Event event;
+            while ((event = xml.next()) != XMLStream::DONE) {
+                if (event == XMLStream::END) {
+                    if (open.empty() || open.back().name != xml.name()) {
+                        throw runtime_error("Mismatched end tag </" + xml.name() + ">");
+                    }
+                    OpenTag tag = std::move(open.back());
+                    open.pop_back();
+                    if (tag.group) {
+                        close(tag.group, tag.has_transform ? tag.transform.c_str() : nullptr,
+                              tag.has_origin ? tag.transform_origin.c_str() : nullptr,
+                              tag.has_id ? tag.id.c_str() : nullptr);
+                    }
+                    continue;
+                }
+                OpenTag tag = {xml.name(), false, nullptr, false, false, false, "", "", ""};
+                if (!root_seen) {
+                    root_seen = true;
+                    dimensions.x = xml.int_attribute("width");
+                    dimensions.y = xml.int_attribute("height");
+                    tag.container = true;
+                } else if (open.empty()) {
+                    throw runtime_error("Content after the root element");
+                } else if (open.back().container) {
+                    const char* value = xml.name().c_str();
+                    SVGElement* element = make_shape(value, xml, arena);
+                    if (!element && strcmp(value, "use") == 0) {
+                        element = make_use(xml, ids, arena);
+                    }
+                    if (element) {
+                        transform_element(element, xml);
+                        add(register_element(element, xml.attribute("id"), ids, arena));
+                    } else if (strcmp(value, "g") == 0) {
+                        tag.container = true;
+                        tag.group = make<Group>(arena, arena);
+                        if (xml.self_closing()) {
+                            close(tag.group, xml.attribute("transform"), xml.attribute("transform-origin"), xml.attribute("id"));
+                            continue;
+                        }
+                        const char* transform = xml.attribute("transform");
+                        const char* transform_origin = xml.attribute("transform-origin");
+                        const char* id = xml.attribute("id");
+                        tag.has_transform = transform != nullptr;
+                        tag.has_origin = transform_origin != nullptr;
+                        tag.has_id = id != nullptr;
+                        tag.transform = transform ? transform : "";
+                        tag.transform_origin = transform_origin ? transform_origin : "";
+                        tag.id = id ? id : "";
+                    }
                 }
-                const char* strokeStr = child->Attribute("stroke");
-                Color stroke = parse_color(strokeStr ? strokeStr : "");
-                element = new Polyline(stroke, points);
-            } else if (strcmp(value, "line") == 0) {
-                int x1 = child->IntAttribute("x1");
-                int y1 = child->IntAttribute("y1");
-                int x2 = child->IntAttribute("x2");
-                int y2 = child->IntAttribute("y2");
-                const char* strokeStr = child->Attribute("stroke");
-                Color stroke = parse_color(strokeStr ? strokeStr : "");
-                element = new Line(stroke, create_point(x1, y1), create_point(x2, y2));
-            } else if (strcmp(value, "polygon") == 0) {
-                vector<Point> points;
-                const char* pointsStr = child->Attribute("points");
-                istringstream pointsStream(pointsStr);
-                string point;
-                while (getline(pointsStream, point, ' ')) {
-                    replace(point.begin(), point.end(), ',', ' ');
-                    istringstream pointStream(point);
-                    int x, y;
-                    pointStream >> x >> y;
-                    points.push_back(create_point(x, y));
+                if (!xml.self_closing()) {
+                    open.push_back(tag);
                 }
-                const char* fillStr = child->Attribute("fill");
-                Color fill = parse_color(fillStr ? fillStr : "");
-                element = new Polygon(fill, points);
-            } else if (strcmp(value, "rect") == 0) {
-                int x = child->IntAttribute("x");
-                int y = child->IntAttribute("y");
-                int width = child->IntAttribute("width");
-                int height = child->IntAttribute("height");
-                const char* fillStr = child->Attribute("fill");
-                Color fill = parse_color(fillStr ? fillStr : "");
-                element = new Rect(fill, create_point(x, y), create_point(x + width-1, y), create_point(x + width-1, y + height-1), create_point(x, y + height-1));
             }
+            if (!root_seen || !open.empty()) {
+                throw runtime_error("Unexpected end of document");
+            }
+        } catch (...) {
+            // Heap elements are deleted here; arena ones go with the arena.
+            if (!arena) {
+                for (const OpenTag& tag : open) {
+                    delete tag.group;
+                }
+                for (size_t i = first_new; i < svg_elements.size(); i++) {
+                    delete svg_elements[i];
+                }
+            }
+            svg_elements.resize(first_new);
+            throw;
+        }
+    }
 
-            if (element) {
-                const char* transform_origin = child->Attribute("transform-origin");
-                Point origin = transform_origin ? create_point(atoi(transform_origin), atoi(strchr(transform_origin, ' ') + 1)) : create_point(0, 0);
-                const char* transform = child->Attribute("transform");
-                if (transform) {
-                    apply_transformations(element, transform, origin);
+    void readSVG(const string& svg_file, Point& dimensions, vector<SVGElement*>& svg_elements, bool use_mmap, Arena* arena) {
+        XMLDocument doc;
+        if (use_mmap) {
+            // tinyxml2 parses in place, so it still copies the mapped pages
+            // once, but the file is not read through a separate buffer.
+            MappedFile mapped(svg_file);
+            if (mapped.valid()) {
+                XMLError r = doc.Parse(mapped.data(), mapped.size());
+                if (r != XML_SUCCESS || doc.RootElement() == nullptr) {
+                    throw runtime_error("Unable to load " + svg_file);
                 }
-                svg_elements.push_back(element);
+                read_document(doc, dimensions, svg_elements, arena);
+                return;
             }
         }
+        XMLError r = doc.LoadFile(svg_file.c_str());
+        if (r != XML_SUCCESS) {
+            throw runtime_error("Unable to load " + svg_file);
+        }
+        read_document(doc, dimensions, svg_elements, arena);
+    }
+
+    void parseSVG(const char* svg_data, size_t size, Point& dimensions, vector<SVGElement*>& svg_elements, Arena* arena) {
+        XMLDocument doc;
+        XMLError r = doc.Parse(svg_data, size);
+        if (r != XML_SUCCESS || doc.RootElement() == nullptr) {
+            throw runtime_error("Unable to parse SVG document");
+        }
+        read_document(doc, dimensions, svg_elements, arena);
+    }
+
+    void streamSVG(const string& svg_file, Point& dimensions, vector<SVGElement*>& svg_elements, bool use_mmap, Arena* arena) {
+        if (use_mmap) {
+            // Tags are read straight from the mapped pages.
+            MappedFile mapped(svg_file);
+            if (mapped.valid()) {
+                XMLStream xml(mapped.data(), mapped.size());
+                stream_document(xml, dimensions, svg_elements, arena);
+                return;
+            }
+        }
+        XMLStream xml(svg_file);
+        stream_document(xml, dimensions, svg_elements, arena);
+    }
+
+    void streamSVG(const char* svg_data, size_t size, Point& dimensions, vector<SVGElement*>& svg_elements, Arena* arena) {
+        XMLStream xml(svg_data, size);
+        stream_document(xml, dimensions, svg_elements, arena);
+    }
+
+    void loadSVG(const string& svg_file, Point& dimensions, vector<SVGElement*>& svg_elements, const RenderOptions& options, Arena* arena) {
+        // A mapped file is parsed in place only by the streaming parser
+        // (the DOM parser copies it), so mmap_input implies streaming.
+        if (options.streaming || options.mmap_input) {
+            streamSVG(svg_file, dimensions, svg_elements, options.mmap_input, arena);
+        } else {
+            readSVG(svg_file, dimensions, svg_elements, false, arena);
+        }
     }
 }
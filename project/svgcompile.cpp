@@ -0,0 +1,47 @@
+#include "SVGElements.hpp"
+#include <iostream>
+#include <cstring>
+
+int main(int argc, char **argv)
+{
+    bool streaming = false, mmap_input = false;
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-')
+    {
+        if (::strcmp(argv[arg], "-s") == 0)
+        {
+            streaming = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-m") == 0)
+        {
+            mmap_input = true;
+            arg++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (argc - arg != 2)
+    {
+        std::cout << "Usage: svgcompile [-s] [-m] in_file.svg out_file.scene" << std::endl;
+        return 1;
+    }
+    svg::Point dimensions;
+    std::vector<svg::SVGElement *> elements;
+    svg::Arena arena;
+    // -m implies -s, as in svgtopng (see RenderOptions::mmap_input).
+    if (streaming || mmap_input)
+    {
+        svg::streamSVG(argv[arg], dimensions, elements, mmap_input, &arena);
+    }
+    else
+    {
+        svg::readSVG(argv[arg], dimensions, elements, mmap_input, &arena);
+    }
+    svg::DisplayList list(elements);
+    list.save(argv[arg + 1], dimensions);
+    std::cout << argv[arg] << " --> " << argv[arg + 1] << ": " << list.size() << " commands" << std::endl;
+    return 0;
+}
@@ -1,17 +1,342 @@
 #include "SVGElements.hpp"
+#include "RenderCache.hpp"
+#include "Batch.hpp"
+#include "RenderServer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Pipe written by the SIGINT and SIGTERM handler. The handler only
+    //! writes to it; a thread of serve() reads it and stops the server.
+    int stop_pipe[2] = {-1, -1};
+
+    void request_stop(int)
+    {
+        int saved = errno;
+        char c = 0;
+        if (::write(stop_pipe[1], &c, 1) < 0)
+        {
+            // A stop is pending already.
+        }
+        errno = saved;
+    }
+
+    //! Serve render requests until interrupted.
+    int serve(const std::string &socket_path, int workers, size_t queue_size, const svg::RenderOptions &options)
+    {
+        svg::RenderServer server(socket_path, workers, queue_size, options);
+        if (::pipe(stop_pipe) != 0)
+        {
+            throw std::runtime_error(std::string("Unable to create pipe: ") + ::strerror(errno));
+        }
+        ::fcntl(stop_pipe[1], F_SETFL, O_NONBLOCK);
+        std::thread stopper([&server]
+                            {
+                                char c;
+                                while (::read(stop_pipe[0], &c, 1) < 0 && errno == EINTR)
+                                {
+                                }
+                                server.stop();
+                            });
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+        std::cout << "Serving on " << socket_path << " with " << workers << " workers" << std::endl;
+        // Restore the default actions, then release the stopper if no
+        // signal came.
+        auto finish = [&stopper]
+        {
+            std::signal(SIGINT, SIG_DFL);
+            std::signal(SIGTERM, SIG_DFL);
+            request_stop(0);
+            stopper.join();
+            ::close(stop_pipe[0]);
+            ::close(stop_pipe[1]);
+        };
+        try
+        {
+            server.run();
+        }
+        catch (...)
+        {
+            finish();
+            throw;
+        }
+        finish();
+        unsigned long long requests = server.requests();
+        std::cout << "Served " << requests << " requests (" << server.failures() << " failed) on "
+                  << server.connections() << " connections, mean server time "
+                  << (requests > 0 ? server.busy_micros() / 1e3 / requests : 0) << " ms" << std::endl;
+        return 0;
+    }
+
+    //! Convert files through a render server over one connection,
+    //! reporting the latency of the requests.
+    int convert_remote(const std::string &socket_path, const std::vector<svg::BatchJob> &jobs,
+                       const svg::RenderOptions &options)
+    {
+        svg::RenderClient client(socket_path);
+        std::vector<double> latencies;
+        double server_ms = 0;
+        bool failed = false;
+        for (const svg::BatchJob &job : jobs)
+        {
+            try
+            {
+                std::ifstream in(job.input, std::ios::binary);
+                if (!in)
+                {
+                    throw std::runtime_error("Unable to load " + job.input);
+                }
+                std::string svg_text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                unsigned micros = 0;
+                auto start = std::chrono::steady_clock::now();
+                std::vector<unsigned char> png = client.convert(svg_text.data(), svg_text.size(), options, &micros);
+                latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                server_ms += micros / 1e3;
+                std::ofstream out(job.output, std::ios::binary);
+                if (!out.write((const char *)png.data(), png.size()))
+                {
+                    throw std::runtime_error("Unable to write " + job.output);
+                }
+            }
+            catch (const std::runtime_error &e)
+            {
+                std::cerr << job.input << ": " << e.what() << std::endl;
+                failed = true;
+            }
+        }
+        if (!latencies.empty())
+        {
+            size_t n = latencies.size();
+            double total = 0;
+            for (double ms : latencies)
+            {
+                total += ms;
+            }
+            std::sort(latencies.begin(), latencies.end());
+            std::cout << "Converted " << n << " of " << jobs.size() << " files, latency (ms): mean " << total / n
+                      << ", p50 " << latencies[n / 2] << ", p99 " << latencies[n * 99 / 100] << ", max "
+                      << latencies[n - 1] << "; mean server time " << server_ms / n << " ms" << std::endl;
+        }
+        return failed ? 1 : 0;
+    }
+}
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    svg::RenderOptions options;
+    std::string cache_dir;
+    unsigned long long cache_mb = 256;
+    int workers = 1;
+    bool manifest = false, directory = false, bad_option = false;
+    std::string serve_socket, remote_socket;
+    size_t queue_size = 16;
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-')
+    {
+        if (::strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            options.threads = std::atoi(argv[arg + 1]);
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+        {
+            options.band_rows = std::atoi(argv[arg + 1]);
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-z") == 0 && arg + 1 < argc)
+        {
+            options.compression = std::atoi(argv[arg + 1]);
+            if (options.compression < 1 || options.compression > 9)
+            {
+                bad_option = true;
+                break;
+            }
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+        {
+            cache_dir = argv[arg + 1];
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-C") == 0 && arg + 1 < argc)
+        {
+            cache_mb = std::strtoull(argv[arg + 1], nullptr, 10);
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-w") == 0 && arg + 1 < argc)
+        {
+            workers = std::atoi(argv[arg + 1]);
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-S") == 0 && arg + 1 < argc)
+        {
+            serve_socket = argv[arg + 1];
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-q") == 0 && arg + 1 < argc)
+        {
+            queue_size = std::strtoul(argv[arg + 1], nullptr, 10);
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-R") == 0 && arg + 1 < argc)
+        {
+            remote_socket = argv[arg + 1];
+            arg += 2;
+        }
+        else if (::strcmp(argv[arg], "-l") == 0)
+        {
+            manifest = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-d") == 0)
+        {
+            directory = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-p") == 0)
+        {
+            options.palette = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-s") == 0)
+        {
+            options.streaming = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-m") == 0)
+        {
+            options.mmap_input = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-a") == 0)
+        {
+            options.antialias = true;
+            arg++;
+        }
+        else if (::strcmp(argv[arg], "-f") == 0)
+        {
+            options.front_to_back = true;
+            arg++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (bad_option || argc - arg != (!serve_socket.empty() ? 0 : manifest ? 1 : 2) || (manifest && directory))
+    {
+        std::cout << "Usage: svgtopng [options] in_file.svg|in_file.scene out_file.png" << std::endl
+                  << "       svgtopng [options] [-w workers] -l manifest" << std::endl
+                  << "       svgtopng [options] [-w workers] -d in_dir out_dir" << std::endl
+                  << "       svgtopng [-j threads] [-w workers] [-q queue_size] -S socket" << std::endl
+                  << "       svgtopng [options] -R socket in_file.svg out_file.png | -l manifest | -d in_dir out_dir" << std::endl
+                  << "Options: [-j threads] [-b band_rows] [-z level (1-9)] [-p] [-s] [-m] [-a] [-f] [-c cache_dir] [-C cache_mb]" << std::endl;
+        return 0;
+    }
+    if (!serve_socket.empty())
+    {
+        try
+        {
+            return serve(serve_socket, workers, queue_size, options);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (!remote_socket.empty())
+    {
+        try
+        {
+            std::vector<svg::BatchJob> jobs = manifest    ? svg::read_manifest(argv[arg])
+                                              : directory ? svg::list_directory(argv[arg], argv[arg + 1])
+                                                          : std::vector<svg::BatchJob>{{argv[arg], argv[arg + 1]}};
+            return convert_remote(remote_socket, jobs, options);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    // The cache creates its directory, so it is only opened once the
+    // arguments are known to be valid.
+    std::unique_ptr<svg::RenderCache> cache;
+    if (!cache_dir.empty())
+    {
+        try
+        {
+            cache.reset(new svg::RenderCache(cache_dir, cache_mb << 20));
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (manifest || directory)
     {
-        std::cout << "Usage: svgtopng in_file.svg out_file.png" << std::endl;
+        try
+        {
+            std::vector<svg::BatchJob> jobs = manifest ? svg::read_manifest(argv[arg])
+                                                       : svg::list_directory(argv[arg], argv[arg + 1]);
+            svg::BatchSummary summary = svg::convert_batch(jobs, options, workers, cache.get());
+            for (const auto &failure : summary.failures)
+            {
+                std::cerr << failure.first << ": " << failure.second << std::endl;
+            }
+            double seconds = summary.seconds > 0 ? summary.seconds : 1e-9;
+            std::cout << "Converted " << summary.converted << " of " << jobs.size() << " files in "
+                      << summary.seconds << " s (" << summary.converted / seconds << " files/s, "
+                      << summary.input_bytes / seconds / 1e6 << " MB/s in, "
+                      << summary.output_bytes / seconds / 1e6 << " MB/s out)" << std::endl;
+            if (cache)
+            {
+                std::cout << "Render cache: " << cache->hits() << " hits, " << cache->misses() << " misses, "
+                          << cache->evictions() << " evictions" << std::endl;
+            }
+            return summary.failures.empty() ? 0 : 1;
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
     }
     else
     {
-        std::cout << "Performing conversion ... " << argv[1] << " --> " << argv[2] << std::endl;
-        svg::convert(argv[1], argv[2]);
+        std::cout << "Performing conversion ... " << argv[arg] << " --> " << argv[arg + 1] << std::endl;
+        svg::RenderStats stats;
+        if (cache)
+        {
+            stats = cache->convert(argv[arg], argv[arg + 1], options);
+            std::cout << "Render cache: " << cache->hits() << " hits, " << cache->misses() << " misses, "
+                      << cache->evictions() << " evictions" << std::endl;
+        }
+        else
+        {
+            stats = svg::convert(argv[arg], argv[arg + 1], options);
+        }
+        if (options.front_to_back)
+        {
+            std::cout << "Pixel writes saved by occlusion culling: " << stats.occluded_writes << std::endl;
+        }
+        std::cout << "Scene arena: " << stats.arena_bytes << " bytes" << std::endl;
         std::cout << "Done!" << std::endl;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,14 +1,31 @@
 
 // Project file headers
 #include "SVGElements.hpp"
+#include "Scene.hpp"
+#include "DisplayList.hpp"
+#include "Arena.hpp"
+#include "RenderCache.hpp"
+#include "Batch.hpp"
+#include "Converter.hpp"
+#include "RenderServer.hpp"
+#include "XMLStream.hpp"
+#include "Color.hpp"
 
 // C++ library headers
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <iomanip>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iterator>
 #include <fstream>
@@ -16,14 +33,73 @@ using namespace std;
 
 // POSIX headers
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <dirent.h>
 
 namespace svg
 {
     const string LOG_FILE_NAME = "test_log.txt";
 
+    //! Document whose shapes cross tile borders and the canvas edges,
+    //! with a last column and row of partial 64x64 tiles and a shape
+    //! outside the canvas.
+    const string EDGES_SVG =
+        "<svg width=\"150\" height=\"70\" xmlns=\"http://www.w3.org/2000/svg\">\n"
+        "  <rect x=\"50\" y=\"0\" width=\"30\" height=\"69\" fill=\"blue\"/>\n"
+        "  <circle cx=\"64\" cy=\"64\" r=\"20\" fill=\"red\"/>\n"
+        "  <ellipse cx=\"140\" cy=\"35\" rx=\"20\" ry=\"40\" fill=\"green\"/>\n"
+        "  <polygon points=\"0,60 140,5 149,69\" fill=\"yellow\"/>\n"
+        "  <line x1=\"0\" y1=\"69\" x2=\"149\" y2=\"0\" stroke=\"black\"/>\n"
+        "  <polyline points=\"5,5 70,40 10,65 140,66\" fill=\"none\" stroke=\"#808000\"/>\n"
+        "  <rect x=\"130\" y=\"66\" width=\"19\" height=\"3\" fill=\"#ff00ff\"/>\n"
+        "  <g transform=\"translate(100 20)\">\n"
+        "    <circle cx=\"0\" cy=\"0\" r=\"12\" fill=\"#00ffff\"/>\n"
+        "    <polygon points=\"-5,-5 5,-5 0,30\" fill=\"#800080\" transform=\"rotate(30)\"/>\n"
+        "  </g>\n"
+        "  <circle cx=\"300\" cy=\"35\" r=\"10\" fill=\"red\"/>\n"
+        "</svg>\n";
+
+    //! Document smaller than one tile.
+    const string SMALL_SVG =
+        "<svg width=\"20\" height=\"10\" xmlns=\"http://www.w3.org/2000/svg\">\n"
+        "  <circle cx=\"17\" cy=\"5\" r=\"6\" fill=\"red\"/>\n"
+        "  <line x1=\"0\" y1=\"0\" x2=\"19\" y2=\"9\" stroke=\"blue\"/>\n"
+        "</svg>\n";
+
+    //! Document whose elements overlap, for scene edits.
+    const string SCENE_SVG =
+        "<svg width=\"80\" height=\"60\" xmlns=\"http://www.w3.org/2000/svg\">\n"
+        "  <rect x=\"10\" y=\"10\" width=\"30\" height=\"20\" fill=\"blue\"/>\n"
+        "  <circle cx=\"35\" cy=\"30\" r=\"12\" fill=\"red\"/>\n"
+        "  <polygon points=\"40,5 70,15 50,45\" fill=\"green\"/>\n"
+        "  <line x1=\"40\" y1=\"45\" x2=\"75\" y2=\"5\" stroke=\"black\"/>\n"
+        "  <ellipse cx=\"60\" cy=\"45\" rx=\"15\" ry=\"8\" fill=\"yellow\"/>\n"
+        "  <polyline points=\"2,58 20,40 40,58 78,30\" fill=\"none\" stroke=\"#808000\"/>\n"
+        "</svg>\n";
+
+    //! Document with nested transformed groups and <use> references.
+    const string NESTED_SVG =
+        "<svg width=\"90\" height=\"70\" xmlns=\"http://www.w3.org/2000/svg\">\n"
+        "  <g id=\"shape\" transform=\"translate(5 5)\">\n"
+        "    <rect x=\"0\" y=\"0\" width=\"20\" height=\"14\" fill=\"blue\"/>\n"
+        "    <g transform-origin=\"10 7\" transform=\"rotate(45)\">\n"
+        "      <polygon points=\"4,2 16,2 10,12\" fill=\"yellow\"/>\n"
+        "      <line x1=\"0\" y1=\"7\" x2=\"20\" y2=\"7\" stroke=\"red\"/>\n"
+        "    </g>\n"
+        "  </g>\n"
+        "  <use href=\"#shape\" transform=\"translate(30 10)\"/>\n"
+        "  <g transform-origin=\"60 45\" transform=\"scale(2)\">\n"
+        "    <use href=\"#shape\" transform=\"translate(50 35)\"/>\n"
+        "    <ellipse cx=\"55\" cy=\"30\" rx=\"6\" ry=\"3\" fill=\"green\"/>\n"
+        "    <polyline points=\"40,40 50,30 60,40\" fill=\"none\" stroke=\"black\"/>\n"
+        "  </g>\n"
+        "</svg>\n";
+
     class TestDriver
     {
     private:
@@ -33,40 +109,1644 @@ namespace svg
         int failed_tests = 0;
         FILE *log_stream;
 
-        bool run_conversion_test(const string &id)
+        string input_file(const string &id) const
+        {
+            return root_path + "/input/" + id + ".svg";
+        }
+
+        string expected_file(const string &id) const
+        {
+            return root_path + "/expected/" + id + ".png";
+        }
+
+        string output_file(const string &name) const
+        {
+            return root_path + "/output/" + name + ".png";
+        }
+
+        //! Check that an output image matches an expected one.
+        bool matches(const string &exp_file, const string &out_file)
+        {
+            PNGImage img1(exp_file), img2(out_file);
+            int w1 = img1.width(), h1 = img1.height(),
+                w2 = img2.width(), h2 = img2.height();
+            if (w1 != w2 || h1 != h2)
+            {
+                std::cout << "Images have different dimensions: "
+                          << w1 << "x" << h1 << " != "
+                          << w2 << "x" << h2 << endl;
+                return false;
+            }
+            ImageDiff diff = img1.compare(img2);
+            if (diff.mismatches > 0)
+            {
+                cout << diff.mismatches << " pixels differ in ("
+                     << diff.bounds.min.x << ' ' << diff.bounds.min.y << ")-("
+                     << diff.bounds.max.x << ' ' << diff.bounds.max.y
+                     << "), max channel delta " << diff.max_delta << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Create an empty directory under output/.
+        string empty_directory(const string &name)
+        {
+            string dir = root_path + "/output/" + name;
+            ::mkdir(dir.c_str(), 0777);
+            if (::DIR *d = ::opendir(dir.c_str()))
+            {
+                while (::dirent *e = ::readdir(d))
+                {
+                    if (e->d_type == DT_REG)
+                    {
+                        ::unlink((dir + "/" + e->d_name).c_str());
+                    }
+                }
+                ::closedir(d);
+            }
+            return dir;
+        }
+
+        //! Write a text file.
+        void write_file(const string &file_name, const string &text)
+        {
+            ofstream out(file_name, ios::binary);
+            out << text;
+        }
+
+        //! Read a whole file.
+        string read_file(const string &file_name)
+        {
+            ifstream in(file_name, ios::binary);
+            return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+
+        //! Write a test document under output/.
+        string document_file(const string &name, const string &svg_text)
+        {
+            string svg_file = root_path + "/output/" + name + ".svg";
+            write_file(svg_file, svg_text);
+            return svg_file;
+        }
+
+        //! Check that a document converts to the same image with two sets
+        //! of options.
+        bool same_conversion(const string &name, const string &svg_text, const RenderOptions &options1,
+                             const RenderOptions &options2)
+        {
+            string svg_file = document_file(name, svg_text);
+            string out_file1 = output_file(name + "_1"), out_file2 = output_file(name + "_2");
+            convert(svg_file, out_file1, options1);
+            convert(svg_file, out_file2, options2);
+            if (!matches(out_file1, out_file2))
+            {
+                cout << name << ": the two conversions differ" << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Convert a test input through a render server and check the result.
+        bool server_converts(RenderClient &client, const string &id)
+        {
+            string svg_text = read_file(input_file(id));
+            vector<unsigned char> png = client.convert(svg_text.data(), svg_text.size(), RenderOptions());
+            string out_file = output_file("server_" + id);
+            write_file(out_file, string(png.begin(), png.end()));
+            return matches(expected_file(id), out_file);
+        }
+
+        //! Check that the server answers a document with an error message.
+        bool server_rejects(RenderClient &client, const string &svg_text, const string &message,
+                            const RenderOptions &options = RenderOptions())
+        {
+            try
+            {
+                client.convert(svg_text.data(), svg_text.size(), options);
+            }
+            catch (const runtime_error &e)
+            {
+                cout << "Server error: " << e.what() << endl;
+                return string(e.what()).find(message) != string::npos;
+            }
+            cout << "No error for: " << svg_text << endl;
+            return false;
+        }
+
+        //! Get the ids of the test inputs starting with spec, in order.
+        bool input_ids(const string &spec, vector<string> &ids)
+        {
+            string dir_path = root_path + "/input";
+            ::DIR *directory = ::opendir(dir_path.c_str());
+            if (directory == nullptr)
+            {
+                cerr << "Unable to open input directory " << dir_path << endl;
+                return false;
+            }
+            ::dirent *entry;
+            while ((entry = readdir(directory)) != nullptr)
+            {
+                if (entry->d_type == DT_REG)
+                {
+                    string fname = entry->d_name;
+                    if (fname.find(spec) == 0)
+                    {
+                        ids.push_back(fname.substr(0, fname.find_last_of('.')));
+                    }
+                }
+            }
+            ::closedir(directory);
+            sort(ids.begin(), ids.end());
+            return true;
+        }
+
+        //! Convert every test input in some mode and check the results
+        //! against the expected images.
+        //! @param mode Mode name (outputs go to output/<mode>/).
+        //! @param conversion Converts an input to an output file.
+        bool converts_all(const string &mode, const function<void(const string &id, const string &out_file)> &conversion)
+        {
+            string dir = empty_directory(mode);
+            vector<string> ids;
+            bool ok = input_ids("", ids);
+            for (const string &id : ids)
+            {
+                string out_file = dir + "/" + id + ".png";
+                conversion(id, out_file);
+                if (!matches(expected_file(id), out_file))
+                {
+                    cout << id << ": mismatch in mode " << mode << endl;
+                    ok = false;
+                }
+            }
+            return ok;
+        }
+
+        bool run_conversion_test(const string &id)
+        {
+            string out_file = output_file(id);
+            convert(input_file(id), out_file);
+            return matches(expected_file(id), out_file);
+        }
+
+        //! Tiled rendering gives the serial image for any number of
+        //! threads, on a canvas with partial tiles and on one smaller than
+        //! a tile.
+        bool test_tiles()
+        {
+            RenderOptions serial;
+            bool ok = true;
+            for (int threads : {2, 3, 8, 64})
+            {
+                RenderOptions tiled;
+                tiled.threads = threads;
+                ok = same_conversion("tiles_edges", EDGES_SVG, serial, tiled) &&
+                     same_conversion("tiles_small", SMALL_SVG, serial, tiled) && ok;
+            }
+            return ok;
+        }
+
+        //! Anti-aliased tiles give the serial image, and coverage only
+        //! blends the pixels on the edges of a shape.
+        bool test_antialias()
+        {
+            RenderOptions serial, tiled;
+            serial.antialias = tiled.antialias = true;
+            tiled.threads = 3;
+            if (!same_conversion("antialias_edges", EDGES_SVG, serial, tiled) ||
+                !same_conversion("antialias_small", SMALL_SVG, serial, tiled))
+            {
+                return false;
+            }
+            string out_file = output_file("antialias_coverage");
+            convert(document_file("antialias_coverage",
+                                  "<svg width=\"40\" height=\"40\" xmlns=\"http://www.w3.org/2000/svg\">"
+                                  "<circle cx=\"12\" cy=\"20\" r=\"9\" fill=\"blue\"/>"
+                                  "<rect x=\"24\" y=\"6\" width=\"12\" height=\"28\" fill=\"blue\"/>"
+                                  "</svg>"),
+                    out_file, serial);
+            PNGImage img(out_file);
+            int blended = 0;
+            for (int y = 0; y < img.height(); y++)
+            {
+                for (int x = 0; x < img.width(); x++)
+                {
+                    // White and blue only mix into grays of blue.
+                    Color c = img.at(x, y);
+                    if (c.blue != 255 || c.red != c.green)
+                    {
+                        cout << "pixel (" << x << ' ' << y << ") is not a blend of white and blue" << endl;
+                        return false;
+                    }
+                    blended += c.red > 0 && c.red < 255;
+                }
+            }
+            for (int x = 25; x < 35; x++)
+            {
+                if (img.at(x, 20).red != 0)
+                {
+                    cout << "pixel (" << x << " 20) inside the rectangle is blended" << endl;
+                    return false;
+                }
+            }
+            if (img.at(12, 20).red != 0 || img.at(0, 0).red != 255 || img.at(39, 39).red != 255 || blended == 0)
+            {
+                cout << "unexpected coverage: " << blended << " blended pixels" << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! An ellipse with a negative radius fills the pixels of the one
+        //! with the matching positive radius, through the span table and
+        //! past it.
+        bool test_ellipses()
+        {
+            for (Point radius : {Point{7, 4}, Point{20000, 5}})
+            {
+                PNGImage positive(40, 20);
+                positive.draw_ellipse({20, 10}, radius, Color{0, 0, 255});
+                for (Point sign : {Point{-1, 1}, Point{1, -1}, Point{-1, -1}})
+                {
+                    PNGImage img(40, 20);
+                    img.draw_ellipse({20, 10}, {radius.x * sign.x, radius.y * sign.y}, Color{0, 0, 255});
+                    ImageDiff diff = positive.compare(img);
+                    if (diff.mismatches > 0)
+                    {
+                        cout << "radius (" << radius.x * sign.x << ' ' << radius.y * sign.y << "): "
+                             << diff.mismatches << " pixels differ" << endl;
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        //! Count the writes that front-to-back drawing skips in a 40x30
+        //! document.
+        unsigned long long occluded_writes(const string &name, const string &shapes)
+        {
+            RenderOptions options;
+            options.front_to_back = true;
+            string svg_text = "<svg width=\"40\" height=\"30\" xmlns=\"http://www.w3.org/2000/svg\">" + shapes + "</svg>";
+            return convert(document_file(name, svg_text), output_file(name), options).occluded_writes;
+        }
+
+        //! Front-to-back drawing gives the back-to-front image when shapes
+        //! partly cover each other, skips every write of a hidden shape,
+        //! and no more writes for shapes that do not overlap than for each
+        //! shape alone (shapes skip their own repeated writes).
+        bool test_front_to_back()
+        {
+            RenderOptions back_to_front, front_to_back, antialias, antialias_front_to_back;
+            front_to_back.front_to_back = antialias_front_to_back.front_to_back = true;
+            antialias.antialias = antialias_front_to_back.antialias = true;
+            RenderOptions tiled = back_to_front, tiled_front_to_back = front_to_back;
+            tiled.threads = tiled_front_to_back.threads = 3;
+            if (!same_conversion("front_to_back_edges", EDGES_SVG, back_to_front, front_to_back) ||
+                !same_conversion("front_to_back_tiled", EDGES_SVG, tiled, tiled_front_to_back) ||
+                !same_conversion("front_to_back_antialias", EDGES_SVG, antialias, antialias_front_to_back))
+            {
+                return false;
+            }
+            const string circle = "<circle cx=\"20\" cy=\"15\" r=\"10\" fill=\"red\"/>",
+                         cover = "<rect x=\"0\" y=\"0\" width=\"39\" height=\"29\" fill=\"blue\"/>",
+                         apart = "<rect x=\"32\" y=\"0\" width=\"7\" height=\"29\" fill=\"blue\"/>";
+            // Drawing the circle writes each of its pixels, plus the writes
+            // it skips by itself.
+            unsigned long long circle_alone = occluded_writes("front_to_back_circle", circle),
+                               circle_writes = circle_alone;
+            PNGImage img(output_file("front_to_back_circle"));
+            for (int y = 0; y < img.height(); y++)
+            {
+                for (int x = 0; x < img.width(); x++)
+                {
+                    circle_writes += img.at(x, y).green == 0;
+                }
+            }
+            unsigned long long hidden = occluded_writes("front_to_back_hidden", circle + cover),
+                               cover_alone = occluded_writes("front_to_back_cover", cover),
+                               beside = occluded_writes("front_to_back_beside", circle + apart),
+                               apart_alone = occluded_writes("front_to_back_apart", apart);
+            if (hidden != cover_alone + circle_writes || beside != circle_alone + apart_alone)
+            {
+                cout << hidden << " occluded writes for a hidden circle of " << circle_writes << " writes, "
+                     << beside << " for shapes apart" << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Check that a box lies within one of a list of boxes.
+        bool covered(const BoundingBox &box, const vector<BoundingBox> &boxes)
+        {
+            for (const BoundingBox &b : boxes)
+            {
+                if (b.min.x <= box.min.x && b.min.y <= box.min.y && box.max.x <= b.max.x && box.max.y <= b.max.y)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //! Edit a scene element, check that the dirty rectangles stay
+        //! disjoint and cover its old and new pixels, then redraw them and
+        //! check the image against a full redraw of a scene with the same
+        //! edits.
+        bool scene_edit(Scene &incremental, Scene &full, size_t i, const function<void(SVGElement &)> &edit)
+        {
+            const PNGImage &img = incremental.render();
+            BoundingBox clip = img.clip(), before = drawn_bounds(incremental.element(i), img).intersect(clip);
+            incremental.update(i, edit);
+            full.update(i, edit);
+            BoundingBox after = drawn_bounds(incremental.element(i), img).intersect(clip);
+            const vector<BoundingBox> &dirty = incremental.dirty();
+            for (size_t j = 0; j < dirty.size(); j++)
+            {
+                for (size_t k = j + 1; k < dirty.size(); k++)
+                {
+                    if (dirty[j].intersects(dirty[k]))
+                    {
+                        cout << "overlapping dirty rectangles" << endl;
+                        return false;
+                    }
+                }
+            }
+            if ((!before.empty() && !covered(before, dirty)) || (!after.empty() && !covered(after, dirty)))
+            {
+                cout << "element " << i << ": dirty rectangles miss its pixels" << endl;
+                return false;
+            }
+            string out_file1 = output_file("scene_edits_1"), out_file2 = output_file("scene_edits_2");
+            incremental.save(out_file1);
+            full.invalidate({{0, 0}, {img.width() - 1, img.height() - 1}});
+            full.save(out_file2);
+            if (!incremental.dirty().empty())
+            {
+                cout << "dirty rectangles left after rendering" << endl;
+                return false;
+            }
+            if (!matches(out_file2, out_file1))
+            {
+                cout << "element " << i << ": incremental and full renders differ" << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Redrawing the dirty rectangles of edited elements that overlap
+        //! others, leave the canvas and come back, or are replaced gives
+        //! the image of a full redraw, with and without anti-aliasing.
+        //! Scenes load with the streaming parser too, and a null
+        //! replacement is rejected.
+        bool test_scene_edits()
+        {
+            string svg_file = document_file("scene_edits", SCENE_SVG);
+            for (bool antialias : {false, true})
+            {
+                RenderOptions options;
+                options.antialias = antialias;
+                Scene incremental(svg_file, options), full(svg_file, options);
+                if (!scene_edit(incremental, full, 1, [](SVGElement &e)
+                                { e.translate({200, 0}); }) ||
+                    !scene_edit(incremental, full, 1, [](SVGElement &e)
+                                { e.translate({-190, 5}); }) ||
+                    !scene_edit(incremental, full, 0, [](SVGElement &e)
+                                { e.translate({15, 12}); }) ||
+                    !scene_edit(incremental, full, 2, [](SVGElement &e)
+                                { e.rotate(30, {40, 30}); }) ||
+                    !scene_edit(incremental, full, 5, [](SVGElement &e)
+                                { e.scale(2, {40, 58}); }))
+                {
+                    return false;
+                }
+                incremental.replace(4, new Circle(Color{0, 0, 255}, {20, 50}, 6));
+                full.replace(4, new Circle(Color{0, 0, 255}, {20, 50}, 6));
+                if (!scene_edit(incremental, full, 4, [](SVGElement &e)
+                                { e.translate({-30, 0}); }))
+                {
+                    return false;
+                }
+            }
+            // Scenes load through the parser the options select.
+            RenderOptions streaming, mapped;
+            streaming.streaming = true;
+            mapped.mmap_input = true;
+            Scene tree(svg_file), streamed(svg_file, streaming), from_mapping(svg_file, mapped);
+            if (tree.render().compare(streamed.render()).mismatches > 0 ||
+                tree.render().compare(from_mapping.render()).mismatches > 0)
+            {
+                cout << "scenes loaded by the streaming parser differ" << endl;
+                return false;
+            }
+            const SVGElement *kept = tree.element(0);
+            try
+            {
+                tree.replace(0, nullptr);
+                cout << "a null element replaced element 0" << endl;
+                return false;
+            }
+            catch (const std::runtime_error &)
+            {
+            }
+            if (tree.element(0) != kept || !tree.dirty().empty())
+            {
+                cout << "a rejected replacement changed the scene" << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Banded output gives the whole image when the band height does
+        //! not divide the image height, with one-row bands, and with bands
+        //! as tall as or taller than the image, also anti-aliased and tiled.
+        bool test_bands()
+        {
+            RenderOptions whole;
+            bool ok = true;
+            for (int rows : {1, 9, 64, 70, 71, 500})
+            {
+                RenderOptions banded;
+                banded.band_rows = rows;
+                ok = same_conversion("bands_" + to_string(rows), EDGES_SVG, whole, banded) && ok;
+            }
+            RenderOptions antialias, antialias_banded, tiled_banded;
+            antialias.antialias = antialias_banded.antialias = true;
+            antialias_banded.band_rows = tiled_banded.band_rows = 9;
+            tiled_banded.threads = 3;
+            return same_conversion("bands_antialias", EDGES_SVG, antialias, antialias_banded) &&
+                   same_conversion("bands_tiled", EDGES_SVG, whole, tiled_banded) && ok;
+        }
+
+        //! Check that a document is written as an indexed PNG of the
+        //! smallest bit depth that fits its colors (or as RGB past 256
+        //! colors) that decodes to the true-color image.
+        //! @return The number of colors (0 on failure).
+        size_t palette_written(const string &name, const string &svg_text, const RenderOptions &options)
+        {
+            RenderOptions palette = options;
+            palette.palette = true;
+            if (!same_conversion(name, svg_text, options, palette))
+            {
+                return 0;
+            }
+            PNGImage img(output_file(name + "_1"));
+            set<int> colors;
+            for (int y = 0; y < img.height(); y++)
+            {
+                for (int x = 0; x < img.width(); x++)
+                {
+                    Color c = img.at(x, y);
+                    colors.insert(c.red << 16 | c.green << 8 | c.blue);
+                }
+            }
+            size_t n = colors.size();
+            int depth = n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8, color_type = n <= 256 ? 3 : 2;
+            // IHDR: bit depth at byte 24, color type at byte 25.
+            string png = read_file(output_file(name + "_2"));
+            if (png.size() < 26 || png[24] != depth || png[25] != color_type)
+            {
+                cout << name << ": " << n << " colors written with bit depth " << (int)png[24] << " and color type "
+                     << (int)png[25] << endl;
+                return 0;
+            }
+            return n;
+        }
+
+        //! Images with 2, 3, 4, 5, 16, 17, 256 and 257 colors, on a width
+        //! that does not fill the last byte of a row, get the smallest
+        //! index depth that fits (or RGB past 256 colors) and decode to the
+        //! true-color image, also when anti-aliased.
+        bool test_palette()
+        {
+            for (size_t colors : {2, 3, 4, 5, 16, 17, 256, 257})
+            {
+                // A 1x1 square of each color but white, on a white canvas
+                // 37 pixels wide.
+                size_t squares = colors - 1;
+                string svg_text = "<svg width=\"37\" height=\"" + to_string(squares / 12 * 3 + 3) + "\">";
+                for (size_t i = 0; i < squares; i++)
+                {
+                    char color[8];
+                    snprintf(color, sizeof(color), "#%02x%02x32", (unsigned)(i & 0xFF), (unsigned)(i >> 8) * 100);
+                    svg_text += "<rect x=\"" + to_string(i % 12 * 3) + "\" y=\"" + to_string(i / 12 * 3) +
+                                "\" width=\"1\" height=\"1\" fill=\"" + color + "\"/>";
+                }
+                svg_text += "</svg>";
+                size_t written = palette_written("palette_" + to_string(colors), svg_text, RenderOptions());
+                if (written != colors)
+                {
+                    cout << "palette_" << colors << ": " << written << " colors" << endl;
+                    return false;
+                }
+            }
+            RenderOptions antialias;
+            antialias.antialias = true;
+            return palette_written("palette_edges", EDGES_SVG, RenderOptions()) != 0 &&
+                   palette_written("palette_antialias", EDGES_SVG, antialias) != 0;
+        }
+
+        //! Check that converting a document in memory fails.
+        bool buffer_rejected(const string &svg_text)
+        {
+            try
+            {
+                convert_buffer(svg_text, RenderOptions());
+            }
+            catch (const runtime_error &e)
+            {
+                cout << e.what() << endl;
+                return true;
+            }
+            cout << "No error for: " << svg_text << endl;
+            return false;
+        }
+
+        //! Converting a document in memory gives the bytes of the file
+        //! conversion, whole and banded, also from a buffer that goes on
+        //! past the document, and bad documents throw.
+        bool test_buffers()
+        {
+            string svg_file = document_file("buffers", EDGES_SVG), out_file = output_file("buffers");
+            for (int band_rows : {0, 9})
+            {
+                RenderOptions options;
+                options.band_rows = band_rows;
+                convert(svg_file, out_file, options);
+                vector<unsigned char> png = convert_buffer(EDGES_SVG, options);
+                if (string(png.begin(), png.end()) != read_file(out_file))
+                {
+                    cout << "band_rows " << band_rows << ": the buffer and file conversions differ" << endl;
+                    return false;
+                }
+            }
+            // The document is followed by bytes that are not part of it.
+            string text = EDGES_SVG + "<svg";
+            string png;
+            convert_buffer(text.data(), EDGES_SVG.size(), [&](const unsigned char *data, size_t len)
+                           { png.append((const char *)data, len); },
+                           RenderOptions());
+            convert(svg_file, out_file, RenderOptions());
+            if (png != read_file(out_file))
+            {
+                cout << "conversion of a sub-range differs" << endl;
+                return false;
+            }
+            return buffer_rejected("") && buffer_rejected("<svg") &&
+                   buffer_rejected("<svg width=\"10\" height=\"10\"><circle");
+        }
+
+        //! Check the result of comparing two images.
+        bool diff_is(const string &what, const ImageDiff &diff, unsigned long long mismatches,
+                     const BoundingBox &bounds, int max_delta)
+        {
+            if (diff.mismatches != mismatches || diff.max_delta != max_delta ||
+                diff.bounds.min.x != bounds.min.x || diff.bounds.min.y != bounds.min.y ||
+                diff.bounds.max.x != bounds.max.x || diff.bounds.max.y != bounds.max.y)
+            {
+                cout << what << ": " << diff.mismatches << " mismatches in ("
+                     << diff.bounds.min.x << ' ' << diff.bounds.min.y << ")-("
+                     << diff.bounds.max.x << ' ' << diff.bounds.max.y
+                     << "), max channel delta " << diff.max_delta << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Comparing images counts the pixels whose channels differ by
+        //! more than the tolerance either way, in the vector blocks of a
+        //! row and in its tail, bounds them, and marks them in the diff
+        //! image; images or diffs of other sizes are rejected.
+        bool test_compare()
+        {
+            // 37 pixels make 111-byte rows, which end in a scalar tail.
+            PNGImage a(37, 4), b(37, 4);
+            a.at(0, 0) = Color{100, 100, 100};
+            b.at(0, 0) = Color{103, 100, 100};
+            a.at(20, 3).green = 0;
+            b.at(20, 3).green = 8;
+            a.at(36, 2) = Color{0, 0, 250};
+            b.at(36, 2) = Color{0, 0, 40};
+            if (!diff_is("tolerance 0", a.compare(b), 3, {{0, 0}, {36, 3}}, 210) ||
+                !diff_is("tolerance 3", a.compare(b, 3), 2, {{20, 2}, {36, 3}}, 210) ||
+                !diff_is("tolerance 8", b.compare(a, 8), 1, {{36, 2}, {36, 2}}, 210) ||
+                !diff_is("tolerance 210", a.compare(b, 210), 0, {{0, 0}, {-1, -1}}, 210) ||
+                !diff_is("same image", a.compare(a), 0, {{0, 0}, {-1, -1}}, 0))
+            {
+                return false;
+            }
+            PNGImage diff(37, 4);
+            diff.fill_span(1, 0, 36, Color{0, 0, 0});
+            a.compare(b, 3, &diff);
+            for (int y = 0; y < 4; y++)
+            {
+                for (int x = 0; x < 37; x++)
+                {
+                    bool red = (x == 20 && y == 3) || (x == 36 && y == 2);
+                    Color c = diff.at(x, y);
+                    if (c.red != 255 || c.green != (red ? 0 : 255) || c.blue != (red ? 0 : 255))
+                    {
+                        cout << "diff pixel (" << x << ' ' << y << ") is wrong" << endl;
+                        return false;
+                    }
+                }
+            }
+            PNGImage narrow(36, 4), band(37, 4, 1, 3);
+            for (auto check : {function<void()>([&] { a.compare(narrow); }),
+                               function<void()>([&] { a.compare(band); }),
+                               function<void()>([&] { a.compare(b, 0, &narrow); }),
+                               function<void()>([&] { a.compare(b, 0, &band); })})
+            {
+                try
+                {
+                    check();
+                    cout << "images of different sizes compared" << endl;
+                    return false;
+                }
+                catch (const runtime_error &)
+                {
+                }
+            }
+            return true;
+        }
+
+        //! Read a document, render its element tree and its display list
+        //! with some options and compare them.
+        bool list_matches_tree(const string &name, const string &svg_text, const RenderOptions &options)
+        {
+            Point dimensions;
+            vector<SVGElement *> elements;
+            readSVG(document_file(name, svg_text), dimensions, elements);
+            PNGImage tree_img(dimensions.x, dimensions.y), list_img(dimensions.x, dimensions.y);
+            render(elements, tree_img, options);
+            DisplayList list(elements);
+            render(list, list_img, options);
+            bool ok = true;
+            ImageDiff diff = tree_img.compare(list_img);
+            if (diff.mismatches > 0)
+            {
+                cout << name << ": " << diff.mismatches << " pixels differ between the element tree and the display list"
+                     << endl;
+                ok = false;
+            }
+            // Each command drawn alone stays within the bounds the tiled
+            // renderer bins it by.
+            for (size_t i = 0; i < list.size() && ok; i++)
+            {
+                PNGImage img(dimensions.x, dimensions.y);
+                img.set_antialiasing(options.antialias);
+                list.draw(i, img);
+                BoundingBox box = drawn_bounds(list, i, img);
+                for (int y = 0; y < img.height(); y++)
+                {
+                    for (int x = 0; x < img.width(); x++)
+                    {
+                        Color c = img.at(x, y);
+                        bool white = c.red == 255 && c.green == 255 && c.blue == 255;
+                        if (!white && (x < box.min.x || x > box.max.x || y < box.min.y || y > box.max.y))
+                        {
+                            cout << name << ": command " << i << " draws (" << x << ' ' << y << ") outside its bounds" << endl;
+                            ok = false;
+                        }
+                    }
+                }
+            }
+            for (SVGElement *e : elements)
+            {
+                delete e;
+            }
+            return ok;
+        }
+
+        //! The display list draws the element tree's image, with nested
+        //! transforms and <use> references, anti-aliased and tiled, and
+        //! each of its commands stays within its bounds.
+        bool test_display_lists()
+        {
+            bool ok = true;
+            for (const string &svg_text : {EDGES_SVG, NESTED_SVG})
+            {
+                string name = svg_text == EDGES_SVG ? "display_lists_edges" : "display_lists_nested";
+                RenderOptions plain, antialias, tiled;
+                antialias.antialias = true;
+                tiled.threads = 3;
+                ok = list_matches_tree(name, svg_text, plain) && list_matches_tree(name, svg_text, antialias) &&
+                     list_matches_tree(name, svg_text, tiled) && ok;
+            }
+            return ok;
+        }
+
+        //! Render a document read into an arena and from the heap, with
+        //! each parser, and compare them.
+        bool arena_matches_heap(const string &name, const string &svg_text)
+        {
+            string svg_file = document_file(name, svg_text);
+            bool ok = true;
+            for (int parser = 0; parser < 3; parser++)
+            {
+                Arena arena(256);
+                Point heap_dimensions, arena_dimensions;
+                vector<SVGElement *> heap_elements, arena_elements;
+                if (parser == 0)
+                {
+                    readSVG(svg_file, heap_dimensions, heap_elements);
+                    readSVG(svg_file, arena_dimensions, arena_elements, false, &arena);
+                }
+                else if (parser == 1)
+                {
+                    parseSVG(svg_text.data(), svg_text.size(), heap_dimensions, heap_elements);
+                    parseSVG(svg_text.data(), svg_text.size(), arena_dimensions, arena_elements, &arena);
+                }
+                else
+                {
+                    streamSVG(svg_file, heap_dimensions, heap_elements);
+                    streamSVG(svg_file, arena_dimensions, arena_elements, false, &arena);
+                }
+                PNGImage heap_img(heap_dimensions.x, heap_dimensions.y), arena_img(arena_dimensions.x, arena_dimensions.y);
+                render(heap_elements, heap_img, RenderOptions());
+                render(arena_elements, arena_img, RenderOptions());
+                for (SVGElement *e : heap_elements)
+                {
+                    delete e;
+                }
+                if (heap_img.compare(arena_img).mismatches > 0 || arena.bytes_used() == 0)
+                {
+                    cout << name << ": parser " << parser << " gives another image in an arena" << endl;
+                    ok = false;
+                }
+            }
+            return ok;
+        }
+
+        //! Arena blocks are aligned and do not overlap, across chunks and
+        //! for blocks larger than a chunk, reset() keeps the largest chunk,
+        //! and documents read into an arena give the heap images.
+        bool test_arena()
+        {
+            Arena arena(64);
+            vector<pair<unsigned char *, size_t>> blocks;
+            size_t total = 0;
+            for (size_t size : {1, 3, 8, 17, 100, 1000, 5000, 2, 64})
+            {
+                for (size_t align : {1, 2, 4, 8, 16, 64})
+                {
+                    unsigned char *p = (unsigned char *)arena.allocate(size, align);
+                    if ((uintptr_t)p % align != 0)
+                    {
+                        cout << "block of " << size << " bytes not aligned on " << align << endl;
+                        return false;
+                    }
+                    ::memset(p, (int)blocks.size(), size);
+                    blocks.push_back({p, size});
+                    total += size;
+                }
+            }
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                for (size_t j = 0; j < blocks[i].second; j++)
+                {
+                    if (blocks[i].first[j] != (unsigned char)i)
+                    {
+                        cout << "block " << i << " overwritten" << endl;
+                        return false;
+                    }
+                }
+            }
+            if (arena.bytes_used() < total || arena.bytes_reserved() < arena.bytes_used())
+            {
+                cout << arena.bytes_used() << " bytes used and " << arena.bytes_reserved() << " reserved for "
+                     << total << " bytes" << endl;
+                return false;
+            }
+            // The chunk made for the largest block was followed by smaller
+            // ones; reset() keeps it, so that block fits again.
+            arena.reset();
+            size_t reserved = arena.bytes_reserved();
+            arena.allocate(5000, 64);
+            if (reserved < 5000 + 64 || arena.bytes_reserved() != reserved || arena.bytes_used() > reserved)
+            {
+                cout << "reset() kept a chunk of " << reserved << " bytes" << endl;
+                return false;
+            }
+            return arena_matches_heap("arena_edges", EDGES_SVG) && arena_matches_heap("arena_nested", NESTED_SVG);
+        }
+
+        //! Check the counters of a cache.
+        bool cache_counts(const RenderCache &cache, unsigned long long hits, unsigned long long misses,
+                          unsigned long long evictions)
+        {
+            if (cache.hits() != hits || cache.misses() != misses || cache.evictions() != evictions)
+            {
+                cout << "Cache counters: " << cache.hits() << " hits, " << cache.misses() << " misses, "
+                     << cache.evictions() << " evictions; expected " << hits << ", " << misses << ", "
+                     << evictions << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Convert a document through a cache and check the hit flag and the
+        //! image.
+        bool cache_converts(RenderCache &cache, const string &svg_file, const RenderOptions &options, bool hit)
+        {
+            string out_file = output_file("cache"), exp_file = output_file("cache_expected");
+            bool was_hit = !hit;
+            cache.convert(svg_file, out_file, options, &was_hit);
+            convert(svg_file, exp_file, options);
+            if (was_hit != hit)
+            {
+                cout << (hit ? "Miss" : "Hit") << " for " << svg_file << endl;
+                return false;
+            }
+            return matches(exp_file, out_file);
+        }
+
+        //! Options that change the image get their own cache entries,
+        //! options that do not share one, and an edited input misses.
+        bool test_cache()
+        {
+            RenderCache cache(empty_directory("cache"));
+            string svg_file = document_file("cache", EDGES_SVG);
+            RenderOptions plain, tiled, antialias, compressed, banded;
+            tiled.threads = 3;
+            antialias.antialias = true;
+            compressed.compression = 9;
+            banded.band_rows = 9;
+            if (!cache_converts(cache, svg_file, plain, false) || !cache_converts(cache, svg_file, tiled, true) ||
+                !cache_converts(cache, svg_file, antialias, false) || !cache_converts(cache, svg_file, compressed, false) ||
+                !cache_converts(cache, svg_file, banded, false) || !cache_converts(cache, svg_file, antialias, true))
+            {
+                return false;
+            }
+            document_file("cache", SMALL_SVG);
+            return cache_converts(cache, svg_file, plain, false) && cache_converts(cache, svg_file, plain, true) &&
+                   cache_counts(cache, 3, 5, 0);
+        }
+
+        //! A cache hit must not hand out an image that later writes to an
+        //! earlier output (of another input) have changed.
+        bool test_cache_outputs()
         {
-            string svg_file = root_path + "/input/" + id + ".svg";
-            string exp_file = root_path + "/expected/" + id + ".png";
-            string out_file = root_path + "/output/" + id + ".png";
-            convert(svg_file, out_file);
-            PNGImage img1(exp_file), img2(out_file);
-            int w1 = img1.width(), h1 = img1.height(),
-                w2 = img2.width(), h2 = img2.height();
-            if (w1 != w2 || h1 != h2)
+            RenderCache cache(empty_directory("cache_outputs"));
+            RenderOptions options;
+            string out_file = output_file("cache_outputs_1"), out_file2 = output_file("cache_outputs_2");
+            bool hit = true;
+            cache.convert(input_file("circle_1"), out_file, options, &hit);
+            if (hit)
             {
-                std::cout << "Images have different dimensions: "
-                          << w1 << "x" << h1 << " != "
-                          << w2 << "x" << h2 << endl;
+                cout << "Hit in an empty cache" << endl;
+                return false;
+            }
+            convert(input_file("rect_1"), out_file, options);
+            cache.convert(input_file("circle_1"), out_file2, options, &hit);
+            if (!hit)
+            {
+                cout << "Miss for a cached input" << endl;
+                return false;
+            }
+            return matches(expected_file("rect_1"), out_file) && matches(expected_file("circle_1"), out_file2);
+        }
+
+        //! Entries are evicted least recently used first, including those
+        //! found in the directory by a new cache.
+        bool test_cache_eviction()
+        {
+            string dir = empty_directory("cache_eviction");
+            RenderOptions options;
+            string circle_file = output_file("cache_eviction_circle"), rect_file = output_file("cache_eviction_rect");
+            convert(input_file("circle_1"), circle_file, options);
+            convert(input_file("rect_1"), rect_file, options);
+            struct stat circle_st, rect_st;
+            ::stat(circle_file.c_str(), &circle_st);
+            ::stat(rect_file.c_str(), &rect_st);
+            // Room for either image, but not both.
+            unsigned long long max_bytes = max(circle_st.st_size, rect_st.st_size);
+            {
+                RenderCache cache(dir, max_bytes);
+                cache.convert(input_file("circle_1"), circle_file, options);
+                cache.convert(input_file("circle_1"), circle_file, options);
+                cache.convert(input_file("rect_1"), rect_file, options);
+                if (!cache_counts(cache, 1, 2, 1))
+                {
+                    return false;
+                }
+                cache.convert(input_file("circle_1"), circle_file, options);
+                if (!cache_counts(cache, 1, 3, 2) || !matches(expected_file("circle_1"), circle_file))
+                {
+                    return false;
+                }
+            }
+            RenderCache cache(dir, max_bytes);
+            cache.convert(input_file("circle_1"), circle_file, options);
+            cache.convert(input_file("rect_1"), rect_file, options);
+            return cache_counts(cache, 1, 1, 1) && matches(expected_file("rect_1"), rect_file);
+        }
+
+        //! Check that reading a batch's jobs fails.
+        bool jobs_rejected(const function<void()> &read_jobs)
+        {
+            try
+            {
+                read_jobs();
+            }
+            catch (const runtime_error &e)
+            {
+                cout << e.what() << endl;
+                return true;
+            }
+            cout << "No error reading the jobs" << endl;
+            return false;
+        }
+
+        //! Check that a list of jobs holds the given input and output file
+        //! names.
+        bool jobs_are(const vector<BatchJob> &jobs, const vector<BatchJob> &expected)
+        {
+            bool ok = jobs.size() == expected.size();
+            for (size_t i = 0; ok && i < jobs.size(); i++)
+            {
+                ok = jobs[i].input == expected[i].input && jobs[i].output == expected[i].output;
+            }
+            if (!ok)
+            {
+                for (const BatchJob &job : jobs)
+                {
+                    cout << "job: '" << job.input << "' -> '" << job.output << "'" << endl;
+                }
+            }
+            return ok;
+        }
+
+        //! Manifests with comments, blank lines, tabs, spaces and missing
+        //! outputs, and directories with other files, give the expected
+        //! jobs; a batch with more workers than jobs, or with no jobs at
+        //! all, converts them like single conversions.
+        bool test_batch()
+        {
+            string dir = empty_directory("batch"), out_dir = empty_directory("batch_out");
+            write_file(dir + "/manifest.txt", "# comment\n"
+                                              "\n"
+                                              "a.svg\tout a.png\n"
+                                              "b.svg   b.png\n"
+                                              "c.svg\n");
+            if (!jobs_are(read_manifest(dir + "/manifest.txt"),
+                          {{"a.svg", "out a.png"}, {"b.svg", "b.png"}, {"c.svg", "c.png"}}))
+            {
+                return false;
+            }
+            document_file("batch/edges", EDGES_SVG);
+            document_file("batch/small", SMALL_SVG);
+            vector<BatchJob> jobs = list_directory(dir, out_dir);
+            if (!jobs_are(jobs, {{dir + "/edges.svg", out_dir + "/edges.png"}, {dir + "/small.svg", out_dir + "/small.png"}}) ||
+                !jobs_rejected([&]
+                               { read_manifest(dir + "/missing.txt"); }) ||
+                !jobs_rejected([&]
+                               { list_directory(dir + "/missing", out_dir); }))
+            {
+                return false;
+            }
+            BatchSummary none = convert_batch({}, RenderOptions(), 4);
+            BatchSummary summary = convert_batch(jobs, RenderOptions(), 8);
+            if (none.converted != 0 || !none.failures.empty() || summary.converted != 2 || !summary.failures.empty())
+            {
+                cout << "Unexpected batch summary" << endl;
+                return false;
+            }
+            convert(dir + "/edges.svg", output_file("batch_edges"));
+            convert(dir + "/small.svg", output_file("batch_small"));
+            return matches(output_file("batch_edges"), out_dir + "/edges.png") &&
+                   matches(output_file("batch_small"), out_dir + "/small.png");
+        }
+
+        //! A file that cannot be converted must not stop the others.
+        bool test_batch_failures()
+        {
+            string dir = empty_directory("batch_failures");
+            write_file(dir + "/no_size.svg", "<svg><circle cx=\"5\" cy=\"5\" r=\"3\" fill=\"red\"/></svg>");
+            vector<BatchJob> jobs = {
+                {input_file("circle_1"), dir + "/circle_1.png"},
+                {dir + "/no_size.svg", dir + "/no_size.png"},
+                {dir + "/missing.svg", dir + "/missing.png"},
+                {input_file("rect_1"), dir + "/rect_1.png"},
+            };
+            BatchSummary summary = convert_batch(jobs, RenderOptions(), 2);
+            for (const auto &failure : summary.failures)
+            {
+                cout << failure.first << ": " << failure.second << endl;
+            }
+            if (summary.converted != 2 || summary.failures.size() != 2 ||
+                summary.failures[0].first != jobs[1].input || summary.failures[1].first != jobs[2].input)
+            {
+                cout << "Unexpected batch summary" << endl;
+                return false;
+            }
+            return matches(expected_file("circle_1"), jobs[0].output) && matches(expected_file("rect_1"), jobs[3].output);
+        }
+
+        //! A converter going from a large document to a small one and back,
+        //! and between whole and banded output, gives the images of fresh
+        //! conversions.
+        bool test_converter_reuse()
+        {
+            string edges_file = document_file("converter_reuse_edges", EDGES_SVG);
+            string small_file = document_file("converter_reuse_small", SMALL_SVG);
+            RenderOptions whole, banded, antialias;
+            banded.band_rows = 9;
+            antialias.antialias = true;
+            const pair<string, RenderOptions> conversions[] = {
+                {edges_file, whole}, {small_file, whole}, {edges_file, banded}, {edges_file, antialias},
+                {small_file, banded}, {edges_file, whole}};
+            Converter converter;
+            for (const auto &c : conversions)
+            {
+                string out_file = output_file("converter_reuse"), exp_file = output_file("converter_reuse_expected");
+                converter.convert(c.first, out_file, c.second);
+                convert(c.first, exp_file, c.second);
+                if (!matches(exp_file, out_file))
+                {
+                    cout << c.first << ": the reused converter gives another image" << endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //! The streaming parser gives the images of the DOM parser, reading
+        //! the file or its memory mapping.
+        bool test_streaming()
+        {
+            RenderOptions streaming, mapped;
+            streaming.streaming = true;
+            mapped.mmap_input = true;
+            return converts_all("streaming", [&](const string &id, const string &out_file)
+                                { convert(input_file(id), out_file, streaming); }) &&
+                   converts_all("mmap_input", [&](const string &id, const string &out_file)
+                                { convert(input_file(id), out_file, mapped); });
+        }
+
+        //! Read the tags of a stream, with some of their attributes, as
+        //! text.
+        string xml_trace(XMLStream &xml)
+        {
+            string trace;
+            for (XMLStream::Event event; (event = xml.next()) != XMLStream::DONE;)
+            {
+                if (event == XMLStream::END)
+                {
+                    trace += "</" + xml.name() + ">";
+                    continue;
+                }
+                trace += "<" + xml.name();
+                for (const char *name : {"width", "id", "t", "k"})
+                {
+                    if (xml.attribute(name) != nullptr)
+                    {
+                        trace += string(" ") + name + "=[" + xml.attribute(name) + "]";
+                    }
+                }
+                trace += xml.self_closing() ? "/>" : ">";
+            }
+            return trace;
+        }
+
+        //! The streaming parser skips declarations, comments, CDATA
+        //! sections and processing instructions holding markup, decodes
+        //! entities and character references in attributes, gives the
+        //! same tags when any of them straddles the end of the file
+        //! buffer, and rejects malformed markup.
+        bool test_xml_stream()
+        {
+            const string document =
+                "<?xml version=\"1.0\"?>\n"
+                "<!DOCTYPE svg [ <!ENTITY e \"<rect/>\"> ]>\n"
+                "<svg width=\"10\">\n"
+                "<!-- <circle/> > -->"
+                "<![CDATA[ <ellipse/> ]] > ]]>"
+                "<?pi <line/> ?>"
+                "text &amp; more"
+                "<g id='a&lt;&gt;&amp;&quot;&apos;b' t=\"x > 'y'\">"
+                "<rect k=\"&#65;&#x42;&#x20AC;&nbsp;&;&#0;\" />"
+                "</g>\n"
+                "<use/>"
+                "</svg>\n";
+            const string expected = "<svg width=[10]><g id=[a<>&\"'b] t=[x > 'y']>"
+                                    "<rect k=[AB\xE2\x82\xAC&nbsp;&;&#0;]/></g><use/></svg>";
+            XMLStream in_memory(document.data(), document.size());
+            string trace = xml_trace(in_memory);
+            if (trace != expected)
+            {
+                cout << "read " << trace << endl;
+                return false;
+            }
+            XMLStream sized(document.data(), document.size());
+            if (sized.next() != XMLStream::START || sized.int_attribute("width") != 10 ||
+                sized.int_attribute("height") != 0)
+            {
+                cout << "bad int_attribute" << endl;
+                return false;
+            }
+            // Text before the document moves each byte of it across the
+            // end of the 64 KiB buffer in turn.
+            string xml_file = root_path + "/output/xml_stream.xml";
+            for (size_t offset = 1; offset <= document.size(); offset++)
+            {
+                write_file(xml_file, string((1 << 16) - offset, ' ') + document);
+                XMLStream from_file(xml_file);
+                trace = xml_trace(from_file);
+                if (trace != expected)
+                {
+                    cout << "offset " << offset << ": read " << trace << endl;
+                    return false;
+                }
+            }
+            for (const char *bad : {"<svg", "<svg><!-- x", "<svg><![CDATA[ x ]>", "<svg><!- x -->",
+                                    "<!DOCTYPE svg [ <!ENTITY e \"x\"> >", "<svg><?pi ?", "< >",
+                                    "<a x=1>", "<a x>", "<a x=\"1/>", "</a x=\"1\">"})
+            {
+                try
+                {
+                    XMLStream xml(bad, ::strlen(bad));
+                    xml_trace(xml);
+                    cout << "read " << bad << endl;
+                    return false;
+                }
+                catch (const runtime_error &)
+                {
+                }
+            }
+            return true;
+        }
+
+        //! Coordinates and transform arguments written with exponents,
+        //! explicit signs, leading dots, more digits than a double holds
+        //! and a second '.' (which starts a new number) give the image of
+        //! the same document written with integers, and a number ending
+        //! in a bare 'e' ends the list.
+        bool test_numbers()
+        {
+            const string numbers =
+                "<svg width=\"40\" height=\"40\" xmlns=\"http://www.w3.org/2000/svg\">"
+                "<polyline points=\"1e1,2E+1 350e-1,.5e1 12345678901234567890e-18 1.5.5,+3e1 38+36 "
+                "1e+0001,39E-0 -1e1 2 5e 7,7\" fill=\"none\" stroke=\"black\"/>"
+                "<polygon points=\"0,0 8e0,0 0,6\" fill=\"red\" transform=\"rotate(9e1 2e1 2e1) translate(+1e0,-2)\"/>"
+                "</svg>";
+            const string integers =
+                "<svg width=\"40\" height=\"40\" xmlns=\"http://www.w3.org/2000/svg\">"
+                "<polyline points=\"10,20 35,5 12,1 0,30 38,36 10,39 -10,2\" fill=\"none\" stroke=\"black\"/>"
+                "<polygon points=\"0,0 8,0 0,6\" fill=\"red\" transform=\"rotate(90 20 20) translate(1,-2)\"/>"
+                "</svg>";
+            RenderOptions streaming;
+            streaming.streaming = true;
+            string expected_png = output_file("numbers_integers");
+            convert(document_file("numbers_integers", integers), expected_png);
+            for (const RenderOptions &options : {RenderOptions(), streaming})
+            {
+                string out_file = output_file("numbers");
+                convert(document_file("numbers", numbers), out_file, options);
+                if (!matches(expected_png, out_file))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //! Color names in any case, short and long hex and rgb() with
+        //! numbers, percentages and out-of-range components parse, with
+        //! surrounding whitespace; anything else throws.
+        bool test_colors()
+        {
+            const struct
+            {
+                const char *text;
+                Color color;
+            } valid[] = {{"red", {255, 0, 0}},
+                         {"CornflowerBlue", {100, 149, 237}},
+                         {"  navy\n", {0, 0, 128}},
+                         {"LIGHTGOLDENRODYELLOW", {250, 250, 210}},
+                         {"green", {0, 255, 0}},
+                         {"yellowgreen", {154, 205, 50}},
+                         {"aliceblue", {240, 248, 255}},
+                         {"#F80", {255, 136, 0}},
+                         {"#1e90ff", {30, 144, 255}},
+                         {"rgb(255, 128, 0)", {255, 128, 0}},
+                         {"RGB( 1 2 3 )", {1, 2, 3}},
+                         {"rgb(10%,20%,30%)", {26, 51, 77}},
+                         {"rgb(300, -5, 127.6)", {255, 0, 128}}};
+            for (const auto &v : valid)
+            {
+                Color c = parse_color(v.text);
+                if (c.red != v.color.red || c.green != v.color.green || c.blue != v.color.blue)
+                {
+                    cout << "\"" << v.text << "\" parsed as " << (int)c.red << ' ' << (int)c.green << ' '
+                         << (int)c.blue << endl;
+                    return false;
+                }
+            }
+            Color prefix = parse_color("redx", 3);
+            if (prefix.red != 255 || prefix.green != 0 || prefix.blue != 0)
+            {
+                cout << "a length-limited name did not parse" << endl;
+                return false;
+            }
+            for (const char *bad : {"", " ", "gren", "reds", "re", "red blue", "#12", "#1234", "#12345g",
+                                    "rgb(1,2)", "rgb(1,2,3", "rgb(1,2,3)x", "rgb(,1,2,3)", "rgb(a,b,c)"})
+            {
+                try
+                {
+                    parse_color(bad);
+                    cout << "parsed \"" << bad << "\"" << endl;
+                    return false;
+                }
+                catch (const runtime_error &)
+                {
+                }
+            }
+            return true;
+        }
+
+        //! Get the geometry of an instance (null if the element is not one).
+        const SVGElement *geometry_of(const SVGElement *element)
+        {
+            const Instance *instance = dynamic_cast<const Instance *>(element);
+            return instance != nullptr ? instance->shared_geometry().get() : nullptr;
+        }
+
+        //! <use> elements, also inside a group that is itself used, share
+        //! one copy of the geometry they refer to with both parsers, with
+        //! and without an arena; transforming one of them moves no other;
+        //! references to unknown ids are ignored.
+        bool test_use_instances()
+        {
+            const string svg_text =
+                "<svg width=\"60\" height=\"40\" xmlns=\"http://www.w3.org/2000/svg\" "
+                "xmlns:xlink=\"http://www.w3.org/1999/xlink\">"
+                "<polygon id=\"tri\" points=\"0,0 10,0 0,10\" fill=\"red\"/>"
+                "<use href=\"#tri\" x=\"20\"/>"
+                "<use xlink:href=\"#tri\" x=\"40\" transform=\"translate(0 10)\"/>"
+                "<g id=\"pair\"><use href=\"#tri\" y=\"20\"/></g>"
+                "<use href=\"#pair\" x=\"20\"/>"
+                "<use href=\"#missing\"/>"
+                "</svg>";
+            string svg_file = document_file("use_instances", svg_text);
+            for (int parser = 0; parser < 4; parser++)
+            {
+                Point dimensions;
+                vector<SVGElement *> elements;
+                Arena arena;
+                Arena *storage = parser % 2 == 1 ? &arena : nullptr;
+                if (parser < 2)
+                {
+                    readSVG(svg_file, dimensions, elements, false, storage);
+                }
+                else
+                {
+                    streamSVG(svg_file, dimensions, elements, false, storage);
+                }
+                bool ok = elements.size() == 5;
+                const SVGElement *tri = ok ? geometry_of(elements[0]) : nullptr;
+                const Group *pair = ok ? dynamic_cast<const Group *>(geometry_of(elements[3])) : nullptr;
+                ok = tri != nullptr && pair != nullptr && pair->elements.size() == 1 &&
+                     geometry_of(elements[1]) == tri && geometry_of(elements[2]) == tri &&
+                     geometry_of(pair->elements[0]) == tri && geometry_of(elements[4]) == pair &&
+                     dynamic_cast<const Instance *>(elements[0])->shared_geometry().use_count() == 4;
+                if (ok)
+                {
+                    BoundingBox first = elements[0]->bounds(), third = elements[2]->bounds();
+                    elements[1]->translate({5, 0});
+                    BoundingBox moved_first = elements[0]->bounds(), moved_third = elements[2]->bounds();
+                    ok = first.min.x == moved_first.min.x && first.max.x == moved_first.max.x &&
+                         third.min.x == moved_third.min.x && third.max.x == moved_third.max.x;
+                }
+                if (storage == nullptr)
+                {
+                    for (SVGElement *e : elements)
+                    {
+                        delete e;
+                    }
+                }
+                if (!ok)
+                {
+                    cout << "parser " << parser << ": <use> elements do not share their geometry" << endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //! Check that a transformation maps points like another one.
+        bool same_mapping(const string &what, const Transform &t1, const Transform &t2)
+        {
+            for (Point p : {Point{0, 0}, Point{15, 20}, Point{-7, 3}, Point{1000, -250}})
+            {
+                Point q1 = t1.apply(p), q2 = t2.apply(p);
+                if (q1.x != q2.x || q1.y != q2.y)
+                {
+                    cout << what << ": (" << p.x << ' ' << p.y << ") maps to (" << q1.x << ' ' << q1.y
+                         << ") and (" << q2.x << ' ' << q2.y << ")" << endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //! Rotations by multiples of 90 degrees are exact integer matrices
+        //! for any sign and number of turns, composition applies the
+        //! right-hand transformation first and is associative, the array
+        //! mapping (integer translation or not, in place or not) agrees
+        //! with the point mapping, and mapped coordinates are clamped to
+        //! the int range.
+        bool test_transforms()
+        {
+            const Point origin = {10, 20};
+            Transform quarter = Transform::rotation(90, origin);
+            if (quarter.a != 0 || quarter.b != 1 || quarter.c != -1 || quarter.d != 0 ||
+                quarter.e != 30 || quarter.f != 10)
+            {
+                cout << "rotation(90) is not exact" << endl;
+                return false;
+            }
+            Point p = quarter.apply({15, 20});
+            if (p.x != 10 || p.y != 25 || !Transform::rotation(360, origin).identity() ||
+                !Transform::rotation(-720, origin).identity() || !Transform::translation({0, 0}).identity())
+            {
+                cout << "bad quarter turn or identity" << endl;
+                return false;
+            }
+            Transform move = Transform::translation({3, -4}), twice = Transform::scaling(2, {1, 1}),
+                      tilt = Transform::rotation(30, origin);
+            if (!same_mapping("rotation(-270)", quarter, Transform::rotation(-270, origin)) ||
+                !same_mapping("rotation(450)", quarter, Transform::rotation(450, origin)) ||
+                !same_mapping("two half turns", Transform::rotation(180, origin) * Transform::rotation(180, origin),
+                              Transform()) ||
+                !same_mapping("30 + 60 degrees", tilt * Transform::rotation(60, origin), quarter) ||
+                !same_mapping("associativity", (move * twice) * tilt, move * (twice * tilt)))
+            {
+                return false;
+            }
+            Transform composed = move * twice;
+            p = composed.apply({5, 7});
+            if (p.x != 12 || p.y != 9)
+            {
+                cout << "composition applied in the wrong order: (" << p.x << ' ' << p.y << ")" << endl;
                 return false;
             }
-            for (int i = 0; i < w1; i++)
+            if (std::fabs((Transform::scaling(3, origin) * tilt).scale_factor() - 3) > 1e-9)
             {
-                for (int j = 0; j < h1; j++)
+                cout << "bad scale factor" << endl;
+                return false;
+            }
+            const Point points[] = {{0, 0}, {15, 20}, {-7, 3}, {1000, -250}, {INT_MAX, INT_MIN}};
+            const size_t n = sizeof(points) / sizeof(points[0]);
+            for (const Transform &t : {move, Transform::translation({INT_MAX, INT_MIN}), quarter, tilt,
+                                       Transform::scaling(INT_MAX, origin) * Transform::scaling(INT_MAX, origin)})
+            {
+                Point out[n], in_place[n];
+                std::copy(points, points + n, in_place);
+                t.apply(points, out, n);
+                t.apply(in_place, in_place, n);
+                for (size_t i = 0; i < n; i++)
                 {
-                    Color c1 = img1.at(i, j), c2 = img2.at(i, j);
-                    if (c1.red != c2.red || c1.green != c2.green || c1.blue != c2.blue)
+                    Point q = t.apply(points[i]);
+                    if (q.x != out[i].x || q.y != out[i].y || q.x != in_place[i].x || q.y != in_place[i].y)
                     {
-                        cout << "pixel (" << i << ' ' << j << "): expected "
-                             << (int)c1.red << ' ' << (int)c1.green << ' ' << (int)c1.blue
-                             << " got "
-                             << (int)c2.red << ' ' << (int)c2.green << ' ' << (int)c2.blue << std::endl;
+                        cout << "array mapping of point " << i << " differs" << endl;
                         return false;
                     }
                 }
             }
+            Point far = Transform::translation({INT_MAX, INT_MIN}).apply({10, -10});
+            Point scaled = (Transform::scaling(INT_MAX, origin) * Transform::scaling(INT_MAX, origin)).apply({-5, 50});
+            if (far.x != INT_MAX || far.y != INT_MIN || scaled.x != INT_MIN || scaled.y != INT_MAX)
+            {
+                cout << "coordinates outside the int range are not clamped" << endl;
+                return false;
+            }
+            return true;
+        }
+
+        //! Check that loading a scene file fails as corrupt.
+        bool scene_rejected(const string &scene_file)
+        {
+            DisplayList list;
+            Point dimensions;
+            try
+            {
+                list.load(scene_file, dimensions);
+            }
+            catch (const runtime_error &e)
+            {
+                cout << e.what() << endl;
+                return string(e.what()).find("corrupt scene file") != string::npos;
+            }
+            cout << "Loaded " << scene_file << endl;
+            return false;
+        }
+
+        //! Every test input saved as a scene file renders like the document,
+        //! and scene files with a bad canvas size or ellipse radius are
+        //! rejected when loaded.
+        bool test_scene_files()
+        {
+            string dir = empty_directory("scene_files");
+            vector<string> ids;
+            if (!input_ids("", ids))
+            {
+                return false;
+            }
+            for (const string &id : ids)
+            {
+                Point dimensions;
+                vector<SVGElement *> elements;
+                readSVG(input_file(id), dimensions, elements);
+                DisplayList(elements).save(dir + "/" + id + ".scene", dimensions);
+                for (SVGElement *e : elements)
+                {
+                    delete e;
+                }
+                convert(dir + "/" + id + ".scene", dir + "/" + id + ".png");
+                if (!matches(expected_file(id), dir + "/" + id + ".png"))
+                {
+                    return false;
+                }
+            }
+            DisplayList list;
+            list.add_ellipse(Color{255, 0, 0}, {5, 5}, {3, 3});
+            list.save(dir + "/negative_width.scene", {-5, 10});
+            list.save(dir + "/zero_height.scene", {10, 0});
+            list.save(dir + "/huge.scene", {1 << 20, 1 << 20});
+            // Overwrite the ellipse radius (after the header, command,
+            // bounding box and center).
+            list.save(dir + "/bad_radius.scene", {10, 10});
+            fstream bad_radius(dir + "/bad_radius.scene", ios::in | ios::out | ios::binary);
+            int32_t radius = INT32_MIN;
+            bad_radius.seekp(40 + 12 + 16 + 8);
+            bad_radius.write(reinterpret_cast<const char *>(&radius), sizeof(radius));
+            bad_radius.close();
+            return scene_rejected(dir + "/negative_width.scene") && scene_rejected(dir + "/zero_height.scene") &&
+                   scene_rejected(dir + "/huge.scene") && scene_rejected(dir + "/bad_radius.scene");
+        }
+
+        //! Convert a document through a render server and check that it
+        //! gives the bytes of a local conversion.
+        bool server_matches(RenderClient &client, const string &svg_text, const RenderOptions &options)
+        {
+            vector<unsigned char> png = client.convert(svg_text.data(), svg_text.size(), options);
+            if (png != convert_buffer(svg_text, options))
+            {
+                cout << "The server and local conversions differ" << endl;
+                return false;
+            }
             return true;
         }
 
+        //! Requests with each option, several on one connection and from
+        //! clients sharing the server's workers, give the bytes of local
+        //! conversions.
+        bool test_server()
+        {
+            string socket_path = root_path + "/output/server.sock";
+            RenderServer server(socket_path, 2, 4, RenderOptions());
+            thread serving([&]
+                           { server.run(); });
+            vector<RenderOptions> options(7);
+            options[1].antialias = true;
+            options[2].front_to_back = true;
+            options[3].palette = true;
+            options[4].streaming = true;
+            options[5].compression = 1;
+            options[6].band_rows = 9;
+            bool ok[3] = {true, true, true};
+            {
+                vector<thread> clients;
+                for (int c = 0; c < 3; c++)
+                {
+                    clients.emplace_back([&, c]
+                                         {
+                                             RenderClient client(socket_path);
+                                             for (const RenderOptions &o : options)
+                                             {
+                                                 ok[c] = server_matches(client, c == 1 ? SMALL_SVG : EDGES_SVG, o) && ok[c];
+                                             }
+                                         });
+                }
+                for (thread &t : clients)
+                {
+                    t.join();
+                }
+            }
+            server.stop();
+            serving.join();
+            return ok[0] && ok[1] && ok[2] && server.connections() == 3 && server.requests() == 3 * options.size() &&
+                   server.failures() == 0;
+        }
+
+        //! Documents that cannot be rendered and requests with bad
+        //! compression levels or band rows get an error response, and the
+        //! connection goes on.
+        bool test_server_errors()
+        {
+            RenderServer server(root_path + "/output/server_errors.sock", 1, 4, RenderOptions());
+            thread serving([&]
+                           { server.run(); });
+            RenderOptions no_compression, over_compression, negative_bands;
+            no_compression.compression = 0;
+            over_compression.compression = 10;
+            negative_bands.band_rows = -1;
+            bool ok;
+            {
+                RenderClient client(root_path + "/output/server_errors.sock");
+                ok = server_rejects(client, "<svg><circle cx=\"5\" cy=\"5\" r=\"3\" fill=\"red\"/></svg>", "invalid canvas size") &&
+                     server_rejects(client, "<svg width=\"100000\" height=\"100000\"></svg>", "invalid canvas size") &&
+                     server_rejects(client, "<svg", "Unable to parse") &&
+                     server_rejects(client, SMALL_SVG, "Invalid compression level 0", no_compression) &&
+                     server_rejects(client, SMALL_SVG, "Invalid compression level 10", over_compression) &&
+                     server_rejects(client, SMALL_SVG, "Invalid band rows -1", negative_bands) &&
+                     server_converts(client, "circle_1");
+            }
+            server.stop();
+            serving.join();
+            return ok && server.requests() == 7 && server.failures() == 6;
+        }
+
+        //! With a single worker, a client keeping its connection open must
+        //! not block the others.
+        bool test_server_idle_client()
+        {
+            ::alarm(60); // fail rather than hang
+            string socket_path = root_path + "/output/server_idle_client.sock";
+            RenderServer server(socket_path, 1, 4, RenderOptions());
+            thread serving([&]
+                           { server.run(); });
+            bool ok, ok2 = false, ok3 = false;
+            {
+                RenderClient idle_client(socket_path);
+                ok = server_converts(idle_client, "circle_1");
+                RenderClient client2(socket_path), client3(socket_path);
+                thread t2([&]
+                          { ok2 = server_converts(client2, "rect_1") && server_converts(client2, "line_1"); });
+                thread t3([&]
+                          { ok3 = server_converts(client3, "polygon_1") && server_converts(client3, "ellipse_1"); });
+                t2.join();
+                t3.join();
+                ok = ok && server_converts(idle_client, "circle_2");
+            }
+            server.stop();
+            serving.join();
+            return ok && ok2 && ok3 && server.connections() == 3 && server.requests() == 6;
+        }
+
+        //! A client that trickles a request is disconnected once it has
+        //! spent IO_TIMEOUT seconds on it, and meanwhile another client is
+        //! served by the other worker.
+        bool test_server_slow_client()
+        {
+            ::alarm(60); // fail rather than hang
+            string socket_path = root_path + "/output/server_slow_client.sock";
+            RenderServer server(socket_path, 2, 4, RenderOptions());
+            thread serving([&]
+                           { server.run(); });
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address;
+            ::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            ::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+            bool ok = ::connect(fd, (const sockaddr *)&address, sizeof(address)) == 0;
+            // Header of a 100-byte document, then the document, a byte
+            // every 200 ms: the whole request would take 23 s.
+            string request = string("\0\0\0\x64\0\0\0\0\0\0\0\x06\0\0\0\0", 16) + string(100, ' ');
+            auto start = chrono::steady_clock::now();
+            double closed_after = -1;
+            for (size_t i = 0; ok && i < request.size() && closed_after < 0; i++)
+            {
+                if (::send(fd, &request[i], 1, MSG_NOSIGNAL) != 1)
+                {
+                    closed_after = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                    break;
+                }
+                pollfd p = {fd, POLLIN, 0};
+                char c;
+                if (::poll(&p, 1, 200) > 0 && ::recv(fd, &c, 1, 0) <= 0)
+                {
+                    closed_after = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                }
+                if (i == 5)
+                {
+                    RenderClient client(socket_path);
+                    auto request_start = chrono::steady_clock::now();
+                    ok = server_converts(client, "circle_1") &&
+                         chrono::steady_clock::now() - request_start < chrono::seconds(2);
+                }
+            }
+            ::close(fd);
+            server.stop();
+            serving.join();
+            cout << "Slow client disconnected after " << closed_after << " s" << endl;
+            return ok && closed_after >= RenderServer::IO_TIMEOUT - 1 && closed_after < RenderServer::IO_TIMEOUT + 3;
+        }
+
         void onTestBegin(const string &id)
         {
             total_tests++;
@@ -88,7 +1768,7 @@ namespace svg
             }
         }
 
-        void run_test(const string& id)
+        void run_test(const string& id, const function<bool()> &test)
         {
             int log_fd = ::fileno(log_stream);
             onTestBegin(id);
@@ -99,7 +1779,7 @@ namespace svg
             
                 ::dup2(log_fd, 1);
                 ::dup2(log_fd, 2);
-                bool success = run_conversion_test(id);
+                bool success = test();
                 ::exit(success ? 0 : 1);
             }
             else if (pid > 0)
@@ -129,40 +1809,62 @@ namespace svg
 
         void run_tests(const string &spec)
         {
-            string dir_path = root_path + "/input";
-            ::DIR *directory = ::opendir(dir_path.c_str());
-            if (directory == nullptr)
+            vector<string> scripts_to_execute;
+            if (!input_ids(spec, scripts_to_execute))
             {
-                cerr << "Unable to open input directory " << dir_path << endl;
                 return;
             }
-            vector<string> scripts_to_execute;
-            ::dirent *entry;
-            while ((entry = readdir(directory)) != nullptr)
+
+            cout << "== " << scripts_to_execute.size() << " tests to execute  ==" << endl;
+            for (string id : scripts_to_execute)
             {
-                if (entry->d_type == DT_REG)
+                run_test(id, [&]
+                         { return run_conversion_test(id); });
+            }
+            const pair<string, bool (TestDriver::*)()> checks[] = {
+                {"tiles", &TestDriver::test_tiles},
+                {"antialias", &TestDriver::test_antialias},
+                {"ellipses", &TestDriver::test_ellipses},
+                {"front_to_back", &TestDriver::test_front_to_back},
+                {"scene_edits", &TestDriver::test_scene_edits},
+                {"bands", &TestDriver::test_bands},
+                {"palette", &TestDriver::test_palette},
+                {"buffers", &TestDriver::test_buffers},
+                {"compare", &TestDriver::test_compare},
+                {"streaming", &TestDriver::test_streaming},
+                {"xml_stream", &TestDriver::test_xml_stream},
+                {"numbers", &TestDriver::test_numbers},
+                {"colors", &TestDriver::test_colors},
+                {"use_instances", &TestDriver::test_use_instances},
+                {"transforms", &TestDriver::test_transforms},
+                {"display_lists", &TestDriver::test_display_lists},
+                {"arena", &TestDriver::test_arena},
+                {"cache", &TestDriver::test_cache},
+                {"cache_outputs", &TestDriver::test_cache_outputs},
+                {"cache_eviction", &TestDriver::test_cache_eviction},
+                {"batch", &TestDriver::test_batch},
+                {"batch_failures", &TestDriver::test_batch_failures},
+                {"converter_reuse", &TestDriver::test_converter_reuse},
+                {"scene_files", &TestDriver::test_scene_files},
+                {"server", &TestDriver::test_server},
+                {"server_errors", &TestDriver::test_server_errors},
+                {"server_idle_client", &TestDriver::test_server_idle_client},
+                {"server_slow_client", &TestDriver::test_server_slow_client},
+            };
+            for (const auto &check : checks)
+            {
+                if (check.first.find(spec) == 0 || spec.empty())
                 {
-                    string fname = entry->d_name;
-                    if (fname.find(spec) == 0)
-                    {
-                        scripts_to_execute.push_back(fname.substr(0, fname.find_last_of('.')));
-                    }
+                    run_test(check.first, [&]
+                             { return (this->*check.second)(); });
                 }
             }
-            ::closedir(directory);
-            if (scripts_to_execute.empty())
+
+            if (total_tests == 0)
             {
                 cout << "No scripts matched the spec: " << spec << endl;
                 return;
             }
-            sort(scripts_to_execute.begin(), scripts_to_execute.end());
-
-            cout << "== " << scripts_to_execute.size() << " tests to execute  ==" << endl;
-            for (string id : scripts_to_execute)
-            {
-                run_test(id);
-            }
-
             cout << "== TEST EXECUTION SUMMARY ==" << endl
                  << "Total tests: " << total_tests << endl
                  << "Passed tests: " << passed_tests << endl